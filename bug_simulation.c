@@ -1,643 +1,5093 @@
 // compiled with: gcc
 // -o bug_simulation bug_simulation.c -g
-// -lraylib -lm -ldl -lpthread -lGL -lrt -lgsl
-// opengl, raylib, gsl libraries required
+// -lraylib -lm -ldl -lpthread -lGL -lrt
+// opengl, raylib libraries required
+//
+// headless (no window, no raylib) batch build:
+// gcc -DHEADLESS -O3 -march=native -o bug_simulation_headless bug_simulation.c
+// -lm -lpthread
+// ./bug_simulation_headless --frames 100000 --threads 8 --seed 1234
+// add -DPROFILE for per phase timings (--profile FILE)
+// add -DCHUNKED_WORLD for worlds too big to hold in full (--set world_width=..)
+// ./bug_simulation_headless --bench all > bench.csv  (compare across builds)
+#ifndef HEADLESS
 #include "raylib.h"
+#endif
 #include <assert.h>
 #include <fcntl.h>
-#include <gsl/gsl_rng.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
-#define WORLD_WIDTH 800
-#define WORLD_HEIGHT 600
-#define SCREEN_WIDTH 1820
-#define SCREEN_HEIGHT 980
+#ifdef HEADLESS
+// the only raylib bits the simulation itself needs
+typedef struct Color {
+  unsigned char r, g, b, a;
+} Color;
+#define BLACK ((Color){0, 0, 0, 255})
+#define RED ((Color){230, 41, 55, 255})
+#define WHITE ((Color){255, 255, 255, 255})
+#endif
+
+#define SCREEN_WIDTH 1820
+#define SCREEN_HEIGHT 980
+#define TARGET_FPS 120
+// fast-forward paints the world this often and simulates in between
+#define FAST_FORWARD_FPS 30
+// E fast-forwards until the population halves or grows by this factor
+#define POP_EVENT_RATIO 2
+
+// The tuning knobs are read at run time, so an experiment needs no rebuild:
+// --set NAME=VALUE changes one, --sweep runs a grid of them. NAME is the
+// knob's macro name in lower case, e.g. mutation_rate
+typedef struct Params {
+  int worldWidth, worldHeight;
+  double initBugProb, initFoodProb, initPoisonProb;
+  int initVision; // vision of the first bugs, -1 = random
+  double regenerateFoodRate, regeneratePoisonRate;
+  int framesTillFood;
+  int foodSizeX, foodSizeY;
+  int nbrFoodSquares;
+  double mutationRate;
+  int foodHealth;
+  double moveCostProb;
+  int poisonCost, moveCost, matingCost, fightingCost;
+  int minMatingAge, minFightingAge;
+} Params;
+
+Params g_params = {
+#ifdef FIXED_WORLD_WIDTH
+    .worldWidth = FIXED_WORLD_WIDTH,
+    .worldHeight = FIXED_WORLD_HEIGHT,
+#else
+    .worldWidth = 800,
+    .worldHeight = 600,
+#endif
+    .initBugProb = 0.0414,
+    .initFoodProb = 0.0,
+    .initPoisonProb = 0.0000,
+    .initVision = -1,
+    .regenerateFoodRate = 0.0000,
+    .regeneratePoisonRate = 0.000000,
+    .framesTillFood = 2,
+    .foodSizeX = 50,
+    .foodSizeY = 50,
+    .nbrFoodSquares = 400,
+    .mutationRate = 0.30,
+    .foodHealth = 10,
+    .moveCostProb = 1.0,
+    .poisonCost = 250,
+    .moveCost = 1,
+    .matingCost = 40,
+    .fightingCost = 40,
+    .minMatingAge = 1,
+    .minFightingAge = 1,
+};
+
+// A build can fix the size of the world (-DFIXED_WORLD_WIDTH=W
+// -DFIXED_WORLD_HEIGHT=H) so every use of it is a constant. With powers of
+// two, cell positions, coordinates and wrapping turn into shifts and masks
+// throughout; any other size still gets its divisions by constants. The
+// world_width and world_height knobs then have to match it
+#if defined(FIXED_WORLD_WIDTH) != defined(FIXED_WORLD_HEIGHT)
+#error "FIXED_WORLD_WIDTH and FIXED_WORLD_HEIGHT go together"
+#endif
+#ifdef FIXED_WORLD_WIDTH
+#define WORLD_WIDTH FIXED_WORLD_WIDTH
+#define WORLD_HEIGHT FIXED_WORLD_HEIGHT
+#else
+#define WORLD_WIDTH g_params.worldWidth
+#define WORLD_HEIGHT g_params.worldHeight
+#endif
+
+#define INIT_BUG_PROB g_params.initBugProb
+#define INIT_FOOD_PROB g_params.initFoodProb
+#define INIT_POISON_PROB g_params.initPoisonProb
+#define INIT_VISION g_params.initVision
+
+#define REGENERATE_FOOD_RATE g_params.regenerateFoodRate
+#define REGENERATE_POISON_RATE g_params.regeneratePoisonRate
+#define FRAMES_TILL_FOOD g_params.framesTillFood
+#define FOOD_SIZE_X g_params.foodSizeX
+#define FOOD_SIZE_Y g_params.foodSizeY
+#define NBR_FOOD_SQUARES g_params.nbrFoodSquares
+#define MUTATION_RATE g_params.mutationRate
+
+#define FOOD_HEALTH g_params.foodHealth
+#define MOVE_COST_PROB g_params.moveCostProb
+#define POISON_COST g_params.poisonCost
+#define MOVE_COST g_params.moveCost
+#define MATING_COST g_params.matingCost
+#define FIGHTING_COST g_params.fightingCost
+#define MIN_MATING_AGE g_params.minMatingAge
+#define MIN_FIGHTING_AGE g_params.minFightingAge
+
+typedef struct ParamName {
+  const char *name;
+  int isInt;
+  size_t offset;
+} ParamName;
+
+#define PARAM(name, field, is_int) {name, is_int, offsetof(Params, field)}
+const ParamName PARAM_NAMES[] = {
+    PARAM("world_width", worldWidth, 1),
+    PARAM("world_height", worldHeight, 1),
+    PARAM("init_bug_prob", initBugProb, 0),
+    PARAM("init_food_prob", initFoodProb, 0),
+    PARAM("init_poison_prob", initPoisonProb, 0),
+    PARAM("init_vision", initVision, 1),
+    PARAM("regenerate_food_rate", regenerateFoodRate, 0),
+    PARAM("regenerate_poison_rate", regeneratePoisonRate, 0),
+    PARAM("frames_till_food", framesTillFood, 1),
+    PARAM("food_size_x", foodSizeX, 1),
+    PARAM("food_size_y", foodSizeY, 1),
+    PARAM("nbr_food_squares", nbrFoodSquares, 1),
+    PARAM("mutation_rate", mutationRate, 0),
+    PARAM("food_health", foodHealth, 1),
+    PARAM("move_cost_prob", moveCostProb, 0),
+    PARAM("poison_cost", poisonCost, 1),
+    PARAM("move_cost", moveCost, 1),
+    PARAM("mating_cost", matingCost, 1),
+    PARAM("fighting_cost", fightingCost, 1),
+    PARAM("min_mating_age", minMatingAge, 1),
+    PARAM("min_fighting_age", minFightingAge, 1),
+};
+#undef PARAM
+#define NBR_PARAMS (int)(sizeof(PARAM_NAMES) / sizeof(PARAM_NAMES[0]))
+u_int64_t g_paramsGiven = 0; // bit k: PARAM_NAMES[k] was set, not default
+
+#define HEADLESS_DEFAULT_FRAMES 1000
+// below this vision a plain scan of the neighbourhood beats the
+// summed-area table lookups
+#define SAT_MIN_VISION 6
+// the tiled step (--threads) aims for tiles this size, and never goes below
+// MIN_TILE_SIZE: a bug reads up to vision 15 around it and writes up to
+// speed 3 away, so tiles of one colour further apart than that never
+// touch the same cells
+#define TILE_TARGET_SIZE 32
+#define MIN_TILE_SIZE 19
+// the movement softmax: the table covers differences up to
+// SOFTMAX_TABLE_RANGE between direction values up to SOFTMAX_VALUE_LIMIT,
+// where it matches exp() exactly; anything else is worked out in full
+#define SOFTMAX_ALPHA 0.01
+#define SOFTMAX_TABLE_RANGE 3500
+#define SOFTMAX_VALUE_LIMIT 70000
+unsigned char g_softmaxPercent[2 * SOFTMAX_TABLE_RANGE + 1];
+int PAUSE = 0;
+u_int64_t g_compactEvery = 0; // frames between bug pool compactions, 0 = never
+int g_compactMorton = 0;      // compact into Morton order (sortBugs)
+u_int64_t g_statsEvery = 1;   // frames between status log lines
+int g_statsDetail = 0;        // add spreads and trait histograms to the log
+int g_verbose = 0;            // print every first bug and its DNA
+
+Color FOOD_COLOR = {0, 255, 0, 255};
+#define FOOD_OPACITY 50
+
+#define BUG_POOL_MIN_CAPACITY 1024
+#define BUG_POOL_LEVELS 4 // enough bitmap levels for 64^4 slots
+
+// All bugs live in one pool of parallel arrays, one per field, so a pass
+// over the population only pulls in the fields it uses. A bug is the index
+// of its slot. Free slots (dead, or never used) are kept in a bitmap with
+// summary levels on top, so the lowest free slot is found in a few word
+// reads and live bugs are visited 64 slots at a time.
+typedef struct BugPool {
+  int capacity; // slots allocated, a multiple of 64
+  int count;    // one past the highest slot ever used
+  int live;     // number of live bugs
+  int *x, *y;   // Position
+  int *age;     // how many frames they've been alive for
+  unsigned char *health; // 0 - 255
+  unsigned char *sex;    // 0|1
+  unsigned char *vision; // 0-15 distance the bug can see
+  unsigned char *speed;  // 0 - 3 - how many squares the bug can move
+  unsigned char *drive;  // 0 - 15 - how much the bug wnats to mate
+  unsigned char *aggr;   // 0 - 15 - how much the bug wants to fight
+  uint32_t *dna;         // this doubles for the bug's color
+  // free[0] has a bit per slot, set while the slot is free; a bit of
+  // free[k] is set while the matching word of free[k - 1] is non-zero
+  u_int64_t *free[BUG_POOL_LEVELS];
+} BugPool;
+
+typedef enum { EMPTY = 0, FOOD = 1, POISON = 2, BUG = 3 } WORLDCELL_TYPE;
+
+// The number of EMPTY cells in each FREE_BLOCK_SIZE square block of the
+// world, so the search for a place to put a baby can pass over full blocks
+// without looking at their cells. Tiles of the tiled step don't line up
+// with blocks, so there the counts are updated atomically.
+#define FREE_BLOCK_SIZE 16
+#define PLACE_RADIUS 32 // rings searched around the mother before giving up
+#ifndef CHUNKED_WORLD
+u_int16_t *g_freeBlocks = NULL;
+#endif
+int g_freeBlocksAcross, g_freeBlocksDown;
+
+// Each world cell is one 32-bit word: the cell type in the low CELL_TYPE_BITS
+// bits and, for BUG cells, the bug's slot above them. Colours are not stored;
+// renderWorld derives them when a frame is drawn. A cell is addressed by its
+// position, made by cellPos from its coordinates.
+#define CELL_TYPE_BITS 2
+#define CELL_TYPE_MASK ((1u << CELL_TYPE_BITS) - 1)
+#ifdef CHUNKED_WORLD
+// The chunked build (-DCHUNKED_WORLD) keeps the world in CHUNK_SIZE square
+// chunks, allocated when something other than EMPTY is first put in them
+// and given back once they are empty again, so memory follows the occupied
+// area rather than the size of the world. Chunks not in use all point at
+// one shared empty chunk, so reading a cell never has to check. A position
+// is the chunk's index above CHUNK_CELL_BITS and the cell's place in the
+// chunk below. Each chunk also holds the free counts of its blocks.
+#define CHUNK_BITS 6
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_CELL_BITS (2 * CHUNK_BITS)
+#define CHUNK_BLOCKS (CHUNK_SIZE / FREE_BLOCK_SIZE) // blocks along a side
+#define CHUNK_TRIM_EVERY 64 // frames between giving back empty chunks
+typedef struct Chunk {
+  u_int32_t cell[CHUNK_SIZE * CHUNK_SIZE];
+  u_int16_t freeCount[CHUNK_BLOCKS * CHUNK_BLOCKS];
+} Chunk;
+Chunk **g_chunks = NULL;
+int g_chunksAcross, g_chunksDown;
+Chunk g_emptyChunk;
+int64_t g_chunksInUse = 0;
+
+static inline u_int64_t cellPos(int x, int y) {
+  u_int64_t chunk =
+      (u_int64_t)(y >> CHUNK_BITS) * g_chunksAcross + (x >> CHUNK_BITS);
+  return chunk << CHUNK_CELL_BITS |
+         (y & (CHUNK_SIZE - 1)) << CHUNK_BITS | (x & (CHUNK_SIZE - 1));
+}
+
+static inline int cellX(u_int64_t pos) {
+  return (pos >> CHUNK_CELL_BITS) % g_chunksAcross * CHUNK_SIZE +
+         (pos & (CHUNK_SIZE - 1));
+}
+
+static inline int cellY(u_int64_t pos) {
+  return (pos >> CHUNK_CELL_BITS) / g_chunksAcross * CHUNK_SIZE +
+         (pos >> CHUNK_BITS & (CHUNK_SIZE - 1));
+}
+
+// a plain read: a tile that races a neighbour allocating the chunk only
+// reads cells the neighbour leaves EMPTY, so either chunk answers right
+static inline Chunk *chunkOf(u_int64_t pos) {
+  return g_chunks[pos >> CHUNK_CELL_BITS];
+}
+
+static inline u_int32_t cellWord(u_int64_t pos) {
+  return chunkOf(pos)->cell[pos & ((1u << CHUNK_CELL_BITS) - 1)];
+}
+
+// the cells from (x, y) rightwards, cutting *n short at the chunk's edge
+static inline const u_int32_t *cellRun(int x, int y, int *n) {
+  if (*n > CHUNK_SIZE - (x & (CHUNK_SIZE - 1)))
+    *n = CHUNK_SIZE - (x & (CHUNK_SIZE - 1));
+  u_int64_t pos = cellPos(x, y);
+  return &chunkOf(pos)->cell[pos & ((1u << CHUNK_CELL_BITS) - 1)];
+}
+#else
+u_int32_t *g_worldCell;
+
+static inline u_int64_t cellPos(int x, int y) {
+  return (u_int64_t)y * WORLD_WIDTH + x;
+}
+
+static inline int cellX(u_int64_t pos) { return pos % WORLD_WIDTH; }
+
+static inline int cellY(u_int64_t pos) { return pos / WORLD_WIDTH; }
+
+static inline u_int32_t cellWord(u_int64_t pos) { return g_worldCell[pos]; }
+
+static inline const u_int32_t *cellRun(int x, int y, int *n) {
+  (void)n; // a row is all one run
+  return &g_worldCell[cellPos(x, y)];
+}
+#endif
+
+static inline int wrapCoord(int v, int size) {
+  // a size fixed in the build at a power of two wraps without branches
+  if (__builtin_constant_p(size) && (size & (size - 1)) == 0)
+    return v & (size - 1);
+  return v < 0 ? v + size : v >= size ? v - size : v;
+}
+
+static inline WORLDCELL_TYPE cellType(u_int64_t screen_pos) {
+  return cellWord(screen_pos) & CELL_TYPE_MASK;
+}
+
+// the bug standing on a BUG cell
+static inline int cellBug(u_int64_t screen_pos) {
+  return cellWord(screen_pos) >> CELL_TYPE_BITS;
+}
+
+BugPool g_bugs;
+u_int32_t g_births = 0, g_fights = 0;
+u_int32_t g_deaths = 0;
+
+// Random numbers are counter based (Philox4x32-10): every draw is a pure
+// function of (seed, frame, id, purpose), where id is the bug slot or world
+// cell the draw is for. No generator state is carried from one draw to the
+// next, so any bug's draws can be made on their own, in any order, in
+// bulk, and a run is replayed bit for bit from its seed.
+u_int64_t g_seed;
+
+typedef enum {
+  RNG_MOVE,        // per bug per frame: x, y, move cost, mate/fight
+  RNG_BIRTH,       // per father per frame: sex, mutation, mutation bit
+  RNG_FOOD,        // per addFood square: x, y
+  RNG_REGENERATE,  // per changed cell per frame: gap, food or poison
+  RNG_INIT_CELL,   // per cell at start: bug, food, poison, sex
+  RNG_INIT_TRAITS, // per cell at start: vision, speed, drive, aggr
+} RNG_PURPOSE;
+
+typedef struct RngBlock {
+  u_int32_t v[4];
+} RngBlock;
+
+// the draws of bug slots [0, g_moveDrawCount) for the current frame,
+// made in one go at the start of the frame
+RngBlock *g_moveDraws = NULL;
+int g_moveDrawCount = 0, g_moveDrawCapacity = 0;
+
+// Summed-area table over the cell types kept as a 2D Fenwick tree so it
+// can be updated in place as cells change. Each node packs the number of
+// FOOD, POISON and BUG cells into 21-bit fields of one word, so a single
+// lookup answers all three counts.
+#define COUNT_BITS 21
+#define COUNT_MASK ((1u << COUNT_BITS) - 1)
+u_int64_t *g_typeTree = NULL;
+u_int64_t g_typeTotal = 0;
+
+
+// Population statistics are kept up to date as bugs are born, die and
+// gain or lose health, so the status line never walks the pool. Each step
+// context collects its own changes, which are folded into g_stats after
+// the frame.
+typedef enum {
+  TRAIT_HEALTH,
+  TRAIT_DRIVE,
+  TRAIT_AGGR,
+  TRAIT_VISION,
+  TRAIT_SPEED,
+  NBR_TRAITS
+} TRAIT;
+#define TRAIT_BINS 16 // every trait is 0-15, health is binned by 16s
+const char *TRAIT_NAMES[NBR_TRAITS] = {"health", "drive", "aggr", "vision",
+                                       "speed"};
+
+typedef struct PopStats {
+  int64_t alive;
+  int64_t sum[NBR_TRAITS];
+  int64_t sumSq[NBR_TRAITS];
+  int32_t hist[NBR_TRAITS][TRAIT_BINS];
+} PopStats;
+PopStats g_stats;
+
+// The genome census: the number of live bugs of every genotype, the trait
+// bits calculateDNA packs into the top of dna (sex, vision, speed, drive,
+// aggr). It is counted with the statistics, so a snapshot (--census) is a
+// read of the table rather than a walk of the pool. Tiles and --procs
+// strips all count into it, so it is shared and counted atomically.
+#define CENSUS_GENOTYPES (1 << 15)
+int32_t *g_census = NULL;
+FILE *g_censusFile = NULL;
+u_int64_t g_censusEvery = 100; // frames between census snapshots
+
+// With --lineage every bug gets an entry in an append-only file when it is
+// born: the frame, its mother's and father's entries (LINEAGE_NONE for the
+// first bugs) and its genotype, so families can be followed back past
+// slots that have since been reused. An entry is its place in the file;
+// only of, the entry of the bug in each slot, is kept in memory. The file
+// is LINEAGE_MAGIC and then the entries, written as they are made (in
+// stdio's blocks), so a run that dies keeps all but the last few.
+#define LINEAGE_MAGIC "BUGLINE"
+#define LINEAGE_NONE 0xffffffffu
+typedef struct LineageEntry {
+  u_int64_t frame;
+  u_int32_t mom, dad, genotype;
+  u_int32_t unused; // written as 0, so the file has no stray padding
+} LineageEntry;
+
+typedef struct Lineage {
+  FILE *file;
+  u_int32_t count; // entries written
+  u_int32_t *of;   // per slot
+} Lineage;
+Lineage g_lineage;
+
+// a birth waiting for the end of a tiled frame, when babies are given slots
+// and placed one tile after another
+typedef struct Baby {
+  u_int64_t mom_pos;
+  int mom, dad;
+  unsigned char health, sex, vision, speed, drive, aggr;
+  int mutation_bit; // -1 when there is no mutation
+  u_int32_t momLine, dadLine; // the parents' lineage entries (--lineage)
+} Baby;
+
+// the events a sequence of bug updates recorded (see --record)
+typedef struct EventBuf {
+  unsigned char *data;
+  size_t size, capacity;
+  int lastSlot;    // slot of the last move, which the next is relative to
+  size_t healthAt; // where that move's health goes once the bug has landed
+} EventBuf;
+
+// Everything one sequence of bug updates needs that isn't per bug: the
+// frame its random numbers are drawn for, what it counted and, for a tile
+// of the tiled step, the births it is holding back
+typedef struct StepCtx {
+  u_int64_t frame;
+  u_int32_t births, fights, deaths;
+  PopStats stats;
+  int deferBirths;
+  EventBuf events;
+  Baby *babies;
+  int nbabies, babyCapacity;
+} StepCtx;
+
+// The tiled step: the world is cut into an even number of tiles each way
+// and coloured like a 2x2 checkerboard. Each frame runs four phases, one
+// per colour. Tiles of one colour are far enough apart to be stepped in
+// parallel, and every draw is keyed by the bug, so the outcome doesn't
+// depend on the number of threads.
+// With --procs the helpers are processes rather than threads, each owning
+// a strip of tile rows (the calling process has the first). Everything the
+// step reads or writes is in memory they all share (see sharedRealloc), so
+// a strip reads the cells along its neighbours' edges straight from their
+// memory, and the phases keep those edges still while it does. What the
+// calling process moves between frames, as the pool grows, is handed to
+// the helpers in a StripShare at the start of every phase.
+typedef struct StripShare {
+  int phase, quit;
+  u_int64_t frame;
+  BugPool bugs;
+  RngBlock *moveDraws;
+  int moveDrawCount;
+  int *order;
+} StripShare;
+
+typedef struct Tiles {
+  int threads; // 0: the classic sequential step
+  int procs;   // the threads are processes, one per strip
+  int rank;    // this process's strip
+  int nx, ny;  // tiles across and down
+  int *tileOfX, *tileOfY;
+  int *first; // tile t's bugs are order[first[t]] .. order[first[t+1]-1]
+  int *order; // live bugs grouped by tile, in slot order
+  int orderCapacity;
+  StepCtx *ctx; // one per tile
+  int *phaseTiles[4];
+  int phaseCount[4];
+  pthread_t *workers;
+  pid_t *pids;
+  pthread_barrier_t *start, *done;
+  StripShare *share;
+  int phase, nextTile, quit;
+  u_int64_t frame;
+} Tiles;
+Tiles g_tiles;
+StepCtx g_serialStep;
+
+#ifdef PROFILE
+// Built with -DPROFILE, every frame's time is split into phases and a few
+// counters, written out per frame (--profile) as CSV or as a Chrome trace
+// for chrome://tracing or Perfetto. Without it the PROFILE_ macros are
+// empty and cost nothing.
+typedef enum {
+  // once per frame on the simulation or window thread; these also become
+  // trace events
+  PROF_DRAWS,
+  PROF_STEP,
+  PROF_BIRTHS,
+  PROF_REGENERATE,
+  PROF_ADD_FOOD,
+  PROF_COMPACT,
+  PROF_STATS,
+  PROF_CHECKPOINT,
+  PROF_PAINT,
+  PROF_UPLOAD,
+  PROF_DRAW,
+  // per bug, on whichever thread steps it; totals only
+  PROF_MOVE,
+  PROF_INTERACT,
+  NBR_PROF_PHASES
+} PROF_PHASE;
+#define PROF_FIRST_PER_BUG PROF_MOVE
+
+typedef enum {
+  PROF_BUG_STEPS,
+  PROF_VISION_CELLS,  // cells visited by scanNeighbourhood
+  PROF_TABLE_LOOKUPS, // summed-area table prefixes read
+  PROF_BABIES_PLACED,
+  PROF_PLACE_CELLS, // cells looked at to place them
+  NBR_PROF_COUNTERS
+} PROF_COUNTER;
+
+const char *PROF_PHASE_NAMES[NBR_PROF_PHASES] = {
+    "draws",      "step",  "births", "regenerate", "add_food",
+    "compact",    "stats", "checkpoint", "paint", "upload",
+    "draw",       "move",  "interact"};
+const char *PROF_COUNTER_NAMES[NBR_PROF_COUNTERS] = {
+    "bug_steps", "vision_cells", "table_lookups", "babies_placed",
+    "place_cells"};
+
+// What one thread has measured since its totals were last taken. The per
+// bug phases and the counters only ever move on simulation threads, which
+// are between frames when the totals are taken, so they are added to
+// without atomics; the window thread's phases are not
+typedef struct ProfTotals {
+  u_int64_t ns[NBR_PROF_PHASES]; // in profNow ticks
+  u_int64_t count[NBR_PROF_COUNTERS];
+  int tid;
+} ProfTotals;
+
+#define PROF_MAX_THREADS 256
+ProfTotals *g_profThreads[PROF_MAX_THREADS];
+int g_profThreadCount = 0;
+pthread_mutex_t g_profLock = PTHREAD_MUTEX_INITIALIZER;
+__thread ProfTotals *t_prof = NULL;
+FILE *g_profFile = NULL;
+int g_profTrace = 0; // Chrome trace rather than CSV
+u_int64_t g_profEpoch = 0;
+double g_profNsPerTick = 1;
+
+static inline u_int64_t profNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// timestamps are in the cheapest clock there is: the time stamp counter on
+// x86, converted to ns only when written out
+static inline u_int64_t profNow(void) {
+#ifdef __x86_64__
+  return __rdtsc();
+#else
+  return profNs();
+#endif
+}
+
+void calibrateProfile(void) {
+#ifdef __x86_64__
+  u_int64_t ns = profNs(), ticks = profNow();
+  usleep(20000);
+  g_profNsPerTick = (double)(profNs() - ns) / (profNow() - ticks);
+#endif
+}
+
+static ProfTotals *profThread(void) {
+  if (t_prof == NULL) {
+    pthread_mutex_lock(&g_profLock);
+    t_prof = calloc(1, sizeof(ProfTotals));
+    if (t_prof == NULL || g_profThreadCount == PROF_MAX_THREADS) {
+      perror("Error: Unable to allocate memory for the profile\n");
+      exit(1);
+    }
+    t_prof->tid = g_profThreadCount;
+    g_profThreads[g_profThreadCount++] = t_prof;
+    pthread_mutex_unlock(&g_profLock);
+  }
+  return t_prof;
+}
+
+// time the phase that began at start; returns the time it ended
+static u_int64_t profAdd(int phase, u_int64_t start) {
+  u_int64_t end = profNow();
+  ProfTotals *prof = profThread();
+  if (phase >= PROF_FIRST_PER_BUG) {
+    prof->ns[phase] += end - start;
+    return end;
+  }
+  __atomic_fetch_add(&prof->ns[phase], end - start, __ATOMIC_RELAXED);
+  if (g_profTrace && g_profFile)
+    fprintf(g_profFile,
+            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f},\n",
+            PROF_PHASE_NAMES[phase], prof->tid,
+            (start - g_profEpoch) * g_profNsPerTick / 1e3,
+            (end - start) * g_profNsPerTick / 1e3);
+  return end;
+}
+
+static inline void profCount(int counter, u_int64_t n) {
+  profThread()->count[counter] += n;
+}
+
+void openProfile(const char *name, int trace) {
+  g_profFile = fopen(name, "w");
+  if (g_profFile == NULL) {
+    perror("Error: Unable to open profile");
+    exit(1);
+  }
+  g_profTrace = trace;
+  g_profEpoch = profNow();
+  if (trace) {
+    fprintf(g_profFile, "[\n");
+    return;
+  }
+  fprintf(g_profFile, "frame");
+  for (int k = 0; k < NBR_PROF_PHASES; ++k)
+    fprintf(g_profFile, ",%s_ns", PROF_PHASE_NAMES[k]);
+  for (int k = 0; k < NBR_PROF_COUNTERS; ++k)
+    fprintf(g_profFile, ",%s", PROF_COUNTER_NAMES[k]);
+  fprintf(g_profFile, "\n");
+}
+
+void closeProfile(void) {
+  if (g_profFile == NULL)
+    return;
+  if (g_profTrace)
+    fprintf(g_profFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"args\":{\"name\":\"bug_simulation\"}}\n]\n");
+  fclose(g_profFile);
+  g_profFile = NULL;
+}
+
+// take every thread's totals for the frame just finished and write them
+void profileFrame(u_int64_t frame) {
+  ProfTotals sum = {0};
+  pthread_mutex_lock(&g_profLock);
+  for (int t = 0; t < g_profThreadCount; ++t) {
+    for (int k = 0; k < NBR_PROF_PHASES; ++k)
+      sum.ns[k] += __atomic_exchange_n(&g_profThreads[t]->ns[k], 0,
+                                       __ATOMIC_RELAXED);
+    for (int k = 0; k < NBR_PROF_COUNTERS; ++k)
+      sum.count[k] += __atomic_exchange_n(&g_profThreads[t]->count[k], 0,
+                                          __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&g_profLock);
+  if (g_profFile == NULL)
+    return;
+  if (!g_profTrace) {
+    fprintf(g_profFile, "%lu", frame);
+    for (int k = 0; k < NBR_PROF_PHASES; ++k)
+      fprintf(g_profFile, ",%.0f", sum.ns[k] * g_profNsPerTick);
+    for (int k = 0; k < NBR_PROF_COUNTERS; ++k)
+      fprintf(g_profFile, ",%lu", sum.count[k]);
+    fprintf(g_profFile, "\n");
+    return;
+  }
+  // the per bug phases and the counters as counter tracks
+  double ts = (profNow() - g_profEpoch) * g_profNsPerTick / 1e3;
+  fprintf(g_profFile,
+          "{\"name\":\"per bug ms\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+          "\"args\":{",
+          ts);
+  for (int k = PROF_FIRST_PER_BUG; k < NBR_PROF_PHASES; ++k)
+    fprintf(g_profFile, "%s\"%s\":%.3f", k > PROF_FIRST_PER_BUG ? "," : "",
+            PROF_PHASE_NAMES[k], sum.ns[k] * g_profNsPerTick / 1e6);
+  fprintf(g_profFile, "}},\n");
+  for (int k = 0; k < NBR_PROF_COUNTERS; ++k)
+    fprintf(g_profFile,
+            "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+            "\"args\":{\"%s\":%lu}},\n",
+            PROF_COUNTER_NAMES[k], ts, PROF_COUNTER_NAMES[k], sum.count[k]);
+}
+
+#define PROFILE_START(phase) u_int64_t prof_start_##phase = profNow()
+#define PROFILE_STOP(phase) profAdd(phase, prof_start_##phase)
+// end one phase and start the next at the same moment
+#define PROFILE_SWITCH(from, to)                                               \
+  u_int64_t prof_start_##to = profAdd(from, prof_start_##from)
+#define PROFILE_COUNT(counter, n) profCount(counter, n)
+#define PROFILE_FRAME(frame) profileFrame(frame)
+#else
+#define PROFILE_START(phase)
+#define PROFILE_STOP(phase)
+#define PROFILE_SWITCH(from, to)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_FRAME(frame)
+#endif
+
+void bugDeath(StepCtx *ctx, int idx, u_int64_t screen_pos);
+void displayBugDNA(int idx);
+void immaculateBirthABug(u_int64_t i, int x, int y, int idx,
+                         PopStats *stats);
+void calculateDNA(int idx);
+void updateStatusLine(u_int64_t frame, FILE *ofp);
+u_int64_t bugMove(StepCtx *ctx, int idx);
+int bugsAreSameSex(int idx1, int idx2);
+void getMovementProbabilities(int idx, int *left_prob, int *up_prob);
+void addFood(RngBlock draw);
+void putFood(int startx, int starty, int width, int height);
+void setCellType(u_int64_t screen_pos, WORLDCELL_TYPE type);
+void setCellBug(u_int64_t screen_pos, int idx);
+void renderWorld(Color *pixels);
+void buildTypeTree(void);
+void simulateFrame(u_int64_t frame);
+void stepBug(StepCtx *ctx, int i);
+int initTiles(int threads, int procs);
+void freeTiles(void);
+int allocBugSlot(void);
+void freeBugSlot(int idx);
+void compactBugs(void);
+void sortBugs(void);
+static void markPacked(int live);
+// int birthABug(Bug *bug, u_int64_t screen_pos);
+
+// a slot is live while its free bit is clear; slots past count are free
+static inline int bugIsAlive(int idx) {
+  return !(__atomic_load_n(&g_bugs.free[0][idx >> 6], __ATOMIC_RELAXED) >>
+               (idx & 63) &
+           1);
+}
+
+// the first live slot at or after idx, or -1. Safe to call while bugs are
+// born and die: every call looks at the current bitmap
+static inline int nextLiveBug(int idx) {
+  int w = idx >> 6;
+  if (idx >= g_bugs.count)
+    return -1;
+  u_int64_t bits = ~g_bugs.free[0][w] & (~0ull << (idx & 63));
+  for (;;) {
+    if (bits) {
+      idx = (w << 6) + __builtin_ctzll(bits);
+      return idx < g_bugs.count ? idx : -1;
+    }
+    if (++w >= g_bugs.capacity >> 6)
+      return -1;
+    bits = ~g_bugs.free[0][w];
+  }
+}
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+// Philox4x32-10: four 32-bit draws for one counter
+static inline RngBlock philox(u_int32_t c0, u_int32_t c1, u_int32_t c2,
+                              u_int32_t c3, u_int32_t k0, u_int32_t k1) {
+  for (int round = 0; round < 10; ++round) {
+    u_int64_t p0 = (u_int64_t)PHILOX_M0 * c0;
+    u_int64_t p1 = (u_int64_t)PHILOX_M1 * c2;
+    u_int32_t n0 = (u_int32_t)(p1 >> 32) ^ c1 ^ k0;
+    u_int32_t n2 = (u_int32_t)(p0 >> 32) ^ c3 ^ k1;
+    c1 = (u_int32_t)p1;
+    c3 = (u_int32_t)p0;
+    c0 = n0;
+    c2 = n2;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  return (RngBlock){{c0, c1, c2, c3}};
+}
+
+// the draws for one (frame, id, purpose)
+static inline RngBlock rngBlock(u_int64_t frame, u_int64_t id, int purpose) {
+  return philox((u_int32_t)frame, (u_int32_t)id, (u_int32_t)(id >> 32),
+                (u_int32_t)(frame >> 32) << 8 | purpose, (u_int32_t)g_seed,
+                (u_int32_t)(g_seed >> 32));
+}
+
+#ifdef __x86_64__
+// the high words of the 32x32-bit products of eight lanes: mul_epu32 only
+// multiplies the even lanes, so the odd ones are shifted down for a second
+// multiply
+__attribute__((target("avx2"))) static inline __m256i mulHi8(__m256i a,
+                                                              __m256i m) {
+  __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a, m), 32);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+  return _mm256_blend_epi32(even, odd, 0xaa);
+}
+
+// rngFill eight ids at a time, one id per lane
+__attribute__((target("avx2"))) static void
+rngFillAvx2(u_int64_t frame, u_int64_t first, int n, int purpose,
+            RngBlock *out) {
+  const __m256i m0 = _mm256_set1_epi32(PHILOX_M0);
+  const __m256i m1 = _mm256_set1_epi32(PHILOX_M1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  u_int32_t c3 = (u_int32_t)(frame >> 32) << 8 | purpose;
+  int k = 0;
+  for (; k + 8 <= n; k += 8) {
+    u_int64_t id = first + k;
+    if ((id ^ (id + 7)) >> 32) {
+      // the ids' high word changes within the batch
+      for (int j = 0; j < 8; ++j, ++id)
+        out[k + j] = philox((u_int32_t)frame, (u_int32_t)id,
+                            (u_int32_t)(id >> 32), c3, (u_int32_t)g_seed,
+                            (u_int32_t)(g_seed >> 32));
+      continue;
+    }
+    __m256i x0 = _mm256_set1_epi32((u_int32_t)frame);
+    __m256i x1 = _mm256_add_epi32(_mm256_set1_epi32((u_int32_t)id), lanes);
+    __m256i x2 = _mm256_set1_epi32((u_int32_t)(id >> 32));
+    __m256i x3 = _mm256_set1_epi32(c3);
+    u_int32_t k0 = (u_int32_t)g_seed, k1 = (u_int32_t)(g_seed >> 32);
+    for (int round = 0; round < 10; ++round) {
+      __m256i hi0 = mulHi8(x0, m0), lo0 = _mm256_mullo_epi32(x0, m0);
+      __m256i hi1 = mulHi8(x2, m1), lo1 = _mm256_mullo_epi32(x2, m1);
+      x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), _mm256_set1_epi32(k0));
+      x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), _mm256_set1_epi32(k1));
+      x1 = lo1;
+      x3 = lo0;
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+    // lanes to blocks: transpose the four words of the eight lanes
+    __m256i t0 = _mm256_unpacklo_epi32(x0, x1);
+    __m256i t1 = _mm256_unpackhi_epi32(x0, x1);
+    __m256i t2 = _mm256_unpacklo_epi32(x2, x3);
+    __m256i t3 = _mm256_unpackhi_epi32(x2, x3);
+    __m256i b04 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i b15 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i b26 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i b37 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i *dst = (__m256i *)&out[k];
+    _mm256_storeu_si256(dst, _mm256_permute2x128_si256(b04, b15, 0x20));
+    _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(b26, b37, 0x20));
+    _mm256_storeu_si256(dst + 2, _mm256_permute2x128_si256(b04, b15, 0x31));
+    _mm256_storeu_si256(dst + 3, _mm256_permute2x128_si256(b26, b37, 0x31));
+  }
+  for (; k < n; ++k) {
+    u_int64_t id = first + k;
+    out[k] = philox((u_int32_t)frame, (u_int32_t)id, (u_int32_t)(id >> 32), c3,
+                    (u_int32_t)g_seed, (u_int32_t)(g_seed >> 32));
+  }
+}
+#endif
+
+// the draws for ids [first, first + n) in one pass, with AVX2 when the CPU
+// has it; the plain loop is simple enough for the compiler to vectorize
+// when it is allowed to
+void rngFill(u_int64_t frame, u_int64_t first, int n, int purpose,
+             RngBlock *out) {
+#ifdef __x86_64__
+  static int has_avx2 = -1;
+  if (has_avx2 < 0)
+    has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) {
+    rngFillAvx2(frame, first, n, purpose, out);
+    return;
+  }
+#endif
+  u_int32_t c3 = (u_int32_t)(frame >> 32) << 8 | purpose;
+  u_int32_t k0 = (u_int32_t)g_seed, k1 = (u_int32_t)(g_seed >> 32);
+  for (int k = 0; k < n; ++k) {
+    u_int64_t id = first + k;
+    out[k] = philox((u_int32_t)frame, (u_int32_t)id, (u_int32_t)(id >> 32), c3,
+                    k0, k1);
+  }
+}
+
+// walk all live bugs in slot order
+#define FOR_EACH_LIVE_BUG(i)                                                   \
+  for (int i = nextLiveBug(0); i >= 0; i = nextLiveBug(i + 1))
+
+static int poolLevelWords(int capacity, int level) {
+  int bits = capacity;
+  for (int k = 0; k < level; ++k)
+    bits = (bits + 63) / 64;
+  return (bits + 63) / 64;
+}
+
+// recompute the summary levels of the free bitmap from free[0]
+static void rebuildFreeSummary(void) {
+  for (int k = 1; k < BUG_POOL_LEVELS; ++k) {
+    int words = poolLevelWords(g_bugs.capacity, k);
+    int below = poolLevelWords(g_bugs.capacity, k - 1);
+    memset(g_bugs.free[k], 0, words * sizeof(u_int64_t));
+    for (int w = 0; w < below; ++w)
+      if (g_bugs.free[k - 1][w])
+        g_bugs.free[k][w >> 6] |= 1ull << (w & 63);
+  }
+}
+
+// The memory shared with --procs helpers: one mapping, made before they are
+// forked so it is at the same address in all of them, handed out from the
+// bottom up and never given back. Each block has a header with its size so
+// sharedRealloc can copy it; growing arrays double, so at most half of
+// what's used is left behind. Without --procs these are realloc and free.
+#define ARENA_HEADER 64
+char *g_arena = NULL;
+size_t g_arenaSize = 0;
+size_t *g_arenaUsed; // at the bottom of the arena, so every process sees it
+
+void openArena(size_t size) {
+  g_arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (g_arena == MAP_FAILED) {
+    perror("Error: Unable to map memory to share with the strips");
+    exit(1);
+  }
+  g_arenaSize = size;
+  g_arenaUsed = (size_t *)g_arena;
+  *g_arenaUsed = ARENA_HEADER;
+}
+
+static inline int inArena(void *array) {
+  return g_arena && (char *)array >= g_arena &&
+         (char *)array < g_arena + g_arenaSize;
+}
+
+// realloc from the arena, whose fresh memory is all zero
+void *sharedRealloc(void *array, size_t size) {
+  if (g_arena == NULL)
+    return realloc(array, size);
+  size_t block =
+      ARENA_HEADER + ((size + ARENA_HEADER - 1) & ~(size_t)(ARENA_HEADER - 1));
+  size_t at = __atomic_fetch_add(g_arenaUsed, block, __ATOMIC_RELAXED);
+  if (at + block > g_arenaSize)
+    return NULL;
+  char *fresh = g_arena + at + ARENA_HEADER;
+  *(size_t *)(fresh - ARENA_HEADER) = size;
+  if (array) {
+    size_t old = *(size_t *)((char *)array - ARENA_HEADER);
+    memcpy(fresh, array, old < size ? old : size);
+  }
+  return fresh;
+}
+
+void *sharedCalloc(size_t n, size_t size) {
+  if (g_arena == NULL)
+    return calloc(n, size);
+  return sharedRealloc(NULL, n * size);
+}
+
+void sharedFree(void *array) {
+  if (!inArena(array))
+    free(array);
+}
+
+static void *growArray(void *array, int capacity, size_t size) {
+  array = sharedRealloc(array, capacity * size);
+  if (array == NULL) {
+    perror("Error: Unable to allocate memory for bugs\n");
+    exit(1);
+  }
+  return array;
+}
+
+// double the pool; the new slots start zeroed and free
+static void growBugPool(void) {
+  int old = g_bugs.capacity;
+  int capacity = old ? old * 2 : BUG_POOL_MIN_CAPACITY;
+#define GROW(field)                                                            \
+  g_bugs.field = growArray(g_bugs.field, capacity, sizeof(*g_bugs.field));     \
+  memset(g_bugs.field + old, 0, (capacity - old) * sizeof(*g_bugs.field))
+  GROW(x);
+  GROW(y);
+  GROW(age);
+  GROW(health);
+  GROW(sex);
+  GROW(vision);
+  GROW(speed);
+  GROW(drive);
+  GROW(aggr);
+  GROW(dna);
+#undef GROW
+  if (g_lineage.file)
+    g_lineage.of = growArray(g_lineage.of, capacity, sizeof(u_int32_t));
+  for (int k = 0; k < BUG_POOL_LEVELS; ++k)
+    g_bugs.free[k] = growArray(g_bugs.free[k],
+                               poolLevelWords(capacity, k), sizeof(u_int64_t));
+  memset(g_bugs.free[0] + (old >> 6), 0xff, (capacity - old) / 8);
+  g_bugs.capacity = capacity;
+  rebuildFreeSummary();
+}
+
+// the lowest free slot, growing the pool when every slot is taken. Returns
+// -1 once the pool holds as many bugs as the world has cells
+int allocBugSlot(void) {
+  int top = BUG_POOL_LEVELS - 1;
+  int words = poolLevelWords(g_bugs.capacity, top);
+  int w = 0;
+  while (w < words && g_bugs.free[top][w] == 0)
+    ++w;
+  int idx;
+  if (w == words) {
+    // a cell holds a slot in its top 32 - CELL_TYPE_BITS bits
+    if (g_bugs.capacity >= (int64_t)WORLD_WIDTH * WORLD_HEIGHT ||
+        g_bugs.capacity >= 1 << (32 - CELL_TYPE_BITS))
+      return -1;
+    idx = g_bugs.capacity;
+    growBugPool();
+  } else {
+    for (int k = top; k >= 0; --k)
+      w = (w << 6) + __builtin_ctzll(g_bugs.free[k][w]);
+    idx = w;
+  }
+  if (idx >= (int64_t)WORLD_WIDTH * WORLD_HEIGHT)
+    return -1;
+  // mark it taken, clearing summary bits whose word just became empty
+  for (int k = 0, s = idx; k < BUG_POOL_LEVELS; ++k, s >>= 6) {
+    g_bugs.free[k][s >> 6] &= ~(1ull << (s & 63));
+    if (g_bugs.free[k][s >> 6])
+      break;
+  }
+  if (idx >= g_bugs.count)
+    g_bugs.count = idx + 1;
+  ++g_bugs.live;
+  return idx;
+}
+
+// bugs of different tiles may die at the same time, so this one is atomic
+void freeBugSlot(int idx) {
+  for (int k = 0, s = idx; k < BUG_POOL_LEVELS; ++k, s >>= 6) {
+    u_int64_t was = __atomic_fetch_or(&g_bugs.free[k][s >> 6],
+                                      1ull << (s & 63), __ATOMIC_RELAXED);
+    if (was)
+      break;
+  }
+  __atomic_fetch_sub(&g_bugs.live, 1, __ATOMIC_RELAXED);
+}
+
+// slide the live bugs down to the lowest slots, keeping their order, so the
+// per-frame passes run over dense arrays again
+void compactBugs(void) {
+  int to = 0;
+  FOR_EACH_LIVE_BUG(from) {
+    if (from != to) {
+      g_bugs.x[to] = g_bugs.x[from];
+      g_bugs.y[to] = g_bugs.y[from];
+      g_bugs.age[to] = g_bugs.age[from];
+      g_bugs.health[to] = g_bugs.health[from];
+      g_bugs.sex[to] = g_bugs.sex[from];
+      g_bugs.vision[to] = g_bugs.vision[from];
+      g_bugs.speed[to] = g_bugs.speed[from];
+      g_bugs.drive[to] = g_bugs.drive[from];
+      g_bugs.aggr[to] = g_bugs.aggr[from];
+      g_bugs.dna[to] = g_bugs.dna[from];
+      if (g_lineage.file)
+        g_lineage.of[to] = g_lineage.of[from];
+      u_int64_t pos = cellPos(g_bugs.x[to], g_bugs.y[to]);
+      if (cellType(pos) == BUG && cellBug(pos) == from)
+        setCellBug(pos, to);
+    }
+    ++to;
+  }
+  markPacked(to);
+}
+
+// the first live slots are taken and the rest free
+static void markPacked(int live) {
+  memset(g_bugs.free[0], 0, (live >> 6) * sizeof(u_int64_t));
+  memset(g_bugs.free[0] + (live >> 6), 0xff,
+         (g_bugs.capacity / 64 - (live >> 6)) * sizeof(u_int64_t));
+  if (live & 63)
+    g_bugs.free[0][live >> 6] = ~0ull << (live & 63);
+  g_bugs.count = live;
+  rebuildFreeSummary();
+}
+
+// x's bits spread out to the even bits
+static inline u_int64_t spreadBits(u_int32_t v) {
+  u_int64_t x = v;
+  x = (x | x << 16) & 0x0000ffff0000ffffull;
+  x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+  x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+  x = (x | x << 2) & 0x3333333333333333ull;
+  x = (x | x << 1) & 0x5555555555555555ull;
+  return x;
+}
+
+typedef struct BugKey {
+  u_int64_t key;
+  int slot;
+} BugKey;
+
+static int compareBugKeys(const void *a, const void *b) {
+  const BugKey *ka = a, *kb = b;
+  if (ka->key != kb->key)
+    return ka->key < kb->key ? -1 : 1;
+  return ka->slot - kb->slot;
+}
+
+// compactBugs, but in the order of the bugs' places along a Morton (Z
+// order) curve rather than their slots, so bugs near each other in the
+// world step one after another and their vision windows share cache
+// lines. Ties go by slot, so the order, and the run, is still fixed by the
+// seed
+void sortBugs(void) {
+  int n = g_bugs.live;
+  BugKey *keys = malloc(n * sizeof(BugKey));
+  void *scratch = malloc(n * sizeof(u_int32_t));
+  if (keys == NULL || scratch == NULL) {
+    perror("Error: Unable to allocate memory to sort bugs");
+    exit(1);
+  }
+  int k = 0;
+  FOR_EACH_LIVE_BUG(i) {
+    keys[k].key = spreadBits(g_bugs.x[i]) | spreadBits(g_bugs.y[i]) << 1;
+    keys[k++].slot = i;
+  }
+  qsort(keys, n, sizeof(BugKey), compareBugKeys);
+  // which bugs are on their cells has to be known before any cell changes
+  unsigned char *on_cell = scratch;
+  for (k = 0; k < n; ++k) {
+    int i = keys[k].slot;
+    u_int64_t pos = cellPos(g_bugs.x[i], g_bugs.y[i]);
+    on_cell[k] = cellType(pos) == BUG && cellBug(pos) == i;
+  }
+  for (k = 0; k < n; ++k)
+    if (on_cell[k])
+      setCellBug(cellPos(g_bugs.x[keys[k].slot], g_bugs.y[keys[k].slot]), k);
+#define PERMUTE_ARRAY(array)                                                   \
+  {                                                                            \
+    __typeof__(array) moved = scratch;                                         \
+    for (k = 0; k < n; ++k)                                                    \
+      moved[k] = array[keys[k].slot];                                          \
+    memcpy(array, moved, n * sizeof(*moved));                                  \
+  }
+#define PERMUTE(field) PERMUTE_ARRAY(g_bugs.field)
+  PERMUTE(x);
+  PERMUTE(y);
+  PERMUTE(age);
+  PERMUTE(health);
+  PERMUTE(sex);
+  PERMUTE(vision);
+  PERMUTE(speed);
+  PERMUTE(drive);
+  PERMUTE(aggr);
+  PERMUTE(dna);
+  if (g_lineage.file)
+    PERMUTE_ARRAY(g_lineage.of);
+#undef PERMUTE
+#undef PERMUTE_ARRAY
+  markPacked(n);
+  free(keys);
+  free(scratch);
+}
+
+static inline void countTrait(PopStats *stats, TRAIT trait, int value,
+                              int sign) {
+  stats->sum[trait] += sign * value;
+  stats->sumSq[trait] += sign * value * value;
+  stats->hist[trait][trait == TRAIT_HEALTH ? value >> 4 : value] += sign;
+}
+
+static inline int genotypeOf(int idx) {
+  return g_bugs.sex[idx] << 14 | g_bugs.vision[idx] << 10 |
+         g_bugs.speed[idx] << 8 | g_bugs.drive[idx] << 4 | g_bugs.aggr[idx];
+}
+
+// add (sign 1) or remove (sign -1) a live bug from the statistics and the
+// census
+static void countBug(PopStats *stats, int idx, int sign) {
+  __atomic_add_fetch(&g_census[genotypeOf(idx)], sign, __ATOMIC_RELAXED);
+  stats->alive += sign;
+  countTrait(stats, TRAIT_HEALTH, g_bugs.health[idx], sign);
+  countTrait(stats, TRAIT_DRIVE, g_bugs.drive[idx], sign);
+  countTrait(stats, TRAIT_AGGR, g_bugs.aggr[idx], sign);
+  countTrait(stats, TRAIT_VISION, g_bugs.vision[idx], sign);
+  countTrait(stats, TRAIT_SPEED, g_bugs.speed[idx], sign);
+}
+
+// every change to a bug's health goes through here to keep the statistics
+static inline void setHealth(StepCtx *ctx, int idx, int health) {
+  if (bugIsAlive(idx)) {
+    countTrait(&ctx->stats, TRAIT_HEALTH, g_bugs.health[idx], -1);
+    countTrait(&ctx->stats, TRAIT_HEALTH, health, 1);
+  }
+  g_bugs.health[idx] = health;
+}
+
+static void foldStats(PopStats *stats) {
+  g_stats.alive += stats->alive;
+  for (int t = 0; t < NBR_TRAITS; ++t) {
+    g_stats.sum[t] += stats->sum[t];
+    g_stats.sumSq[t] += stats->sumSq[t];
+    for (int b = 0; b < TRAIT_BINS; ++b)
+      g_stats.hist[t][b] += stats->hist[t][b];
+  }
+  memset(stats, 0, sizeof(PopStats));
+}
+
+// one line per genotype there are bugs of
+static void writeCensus(u_int64_t frame) {
+  for (int g = 0; g < CENSUS_GENOTYPES; ++g)
+    if (g_census[g])
+      fprintf(g_censusFile, "%lu,%d,%d,%d,%d,%d,%d\n", frame, g >> 14,
+              g >> 10 & 0x0f, g >> 8 & 0x03, g >> 4 & 0x0f, g & 0x0f,
+              g_census[g]);
+}
+
+void openCensus(const char *name, u_int64_t every) {
+  g_censusFile = fopen(name, "w");
+  if (g_censusFile == NULL) {
+    perror("Error: Unable to open census file");
+    exit(1);
+  }
+  fprintf(g_censusFile, "frame,sex,vision,speed,drive,aggr,bugs\n");
+  g_censusEvery = every ? every : 1;
+}
+
+void closeCensus(void) {
+  if (g_censusFile && fclose(g_censusFile) != 0)
+    perror("Error: Unable to write census file");
+  g_censusFile = NULL;
+}
+
+void openLineage(const char *name) {
+  g_lineage.file = fopen(name, "wb");
+  if (g_lineage.file == NULL) {
+    perror("Error: Unable to open lineage file");
+    exit(1);
+  }
+  fwrite(LINEAGE_MAGIC, 1, 8, g_lineage.file);
+}
+
+void closeLineage(void) {
+  if (g_lineage.file == NULL)
+    return;
+  int failed = ferror(g_lineage.file);
+  if (fclose(g_lineage.file) != 0 || failed)
+    perror("Error: Unable to write lineage file");
+  sharedFree(g_lineage.of);
+  g_lineage.file = NULL;
+}
+
+// give the bug in slot idx its entry, a child of entries mom and dad
+static void addLineage(int idx, u_int64_t frame, u_int32_t mom,
+                       u_int32_t dad) {
+  LineageEntry entry = {.frame = frame,
+                        .mom = mom,
+                        .dad = dad,
+                        .genotype = genotypeOf(idx)};
+  fwrite(&entry, sizeof(entry), 1, g_lineage.file);
+  g_lineage.of[idx] = g_lineage.count++;
+}
+
+void displayBugDNA(int idx) {
+  int i;
+
+  for (i = 31; i >= 0; i--) {
+    printf("%u", (g_bugs.dna[idx] >> i) & 1);
+    if (i % 8 == 0)
+      printf(" ");
+  }
+  printf("\nHealth: (%u) -> %u\n", g_bugs.health[idx], g_bugs.dna[idx] & 0xff);
+  printf("Sex: (%u) %u\n", g_bugs.sex[idx], g_bugs.dna[idx] >> 31 & 0x01);
+  printf("Vision:(%u) %u\n", g_bugs.vision[idx], g_bugs.dna[idx] >> 27 & 0x0f);
+  printf("Speed:(%u) %u\n", g_bugs.speed[idx], g_bugs.dna[idx] >> 25 & 0x03);
+  printf("Drive:(%u) %u\n", g_bugs.drive[idx], g_bugs.dna[idx] >> 21 & 0x0f);
+  printf("Aggr:(%u) %u\n", g_bugs.aggr[idx], g_bugs.dna[idx] >> 17 & 0x0f);
+}
+
+// a first bug on cell (x, y), whose draws are numbered i, in slot idx
+void immaculateBirthABug(u_int64_t i, int x, int y, int idx,
+                         PopStats *stats) {
+  RngBlock cell = rngBlock(0, i, RNG_INIT_CELL);
+  RngBlock traits = rngBlock(0, i, RNG_INIT_TRAITS);
+  g_bugs.x[idx] = x;
+  g_bugs.y[idx] = y;
+  g_bugs.age[idx] = 0;
+  g_bugs.sex[idx] = cell.v[3] % 2;
+  g_bugs.health[idx] = 255;
+  g_bugs.vision[idx] = INIT_VISION < 0 ? (int)(traits.v[0] % 16) : INIT_VISION;
+  g_bugs.speed[idx] = traits.v[1] % 4;
+  g_bugs.drive[idx] = traits.v[2] % 16;
+  g_bugs.aggr[idx] = traits.v[3] % 16;
+  calculateDNA(idx);
+  setCellBug(cellPos(x, y), idx);
+  countBug(stats, idx, 1);
+}
+
+void calculateDNA(int idx) {
+  u_int16_t unused = 0xff;
+  g_bugs.dna[idx] = 0;
+  g_bugs.dna[idx] |= g_bugs.sex[idx] << 31;
+  g_bugs.dna[idx] |= g_bugs.vision[idx] << 27;
+  g_bugs.dna[idx] |= g_bugs.speed[idx] << 25;
+  g_bugs.dna[idx] |= g_bugs.drive[idx] << 21;
+  g_bugs.dna[idx] |= g_bugs.aggr[idx] << 17;
+  g_bugs.dna[idx] |= unused << 9;
+  g_bugs.dna[idx] |= g_bugs.health[idx];
+}
+// Telemetry is the binary alternative to the status log: every status frame
+// the simulation copies g_stats into a ring, and a writer thread of its own
+// turns the records into columns and writes them out, so the simulation
+// never formats text or waits for the disk. If the writer falls behind and
+// the ring fills, records are dropped (and counted) rather than waited for.
+//
+// The file is a TelemetryHeader and the column names, then blocks of up to
+// TELEMETRY_BLOCK_ROWS rows: the row count (u32), then per column its byte
+// length (u32) and its values. A value is stored as the difference from the
+// one above it (from 0 at the top of a block), zigzagged and in 7-bit
+// groups, so a statistic that changes slowly takes a byte or two a frame.
+// --telemetry-csv turns a file back into CSV.
+#define TELEMETRY_MAGIC "BUGTELEM"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RING 4096 // records, a power of two
+#define TELEMETRY_BLOCK_ROWS 1024
+#define TELEMETRY_NAME_SIZE 28
+// frame, alive, then per trait the sum, the sum of squares and the bins
+#define TELEMETRY_COLUMNS (2 + NBR_TRAITS * (2 + TRAIT_BINS))
+
+typedef struct TelemetryHeader {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t columns; // each a TELEMETRY_NAME_SIZE name
+} TelemetryHeader;
+
+typedef struct TelemetryRecord {
+  u_int64_t frame;
+  PopStats stats;
+} TelemetryRecord;
+
+typedef struct Telemetry {
+  FILE *file;
+  TelemetryRecord *ring;
+  u_int64_t head;    // records pushed, written by the simulation only
+  u_int64_t tail;    // records taken, written by the writer only
+  u_int64_t dropped; // records the ring had no room for
+  int done;
+  pthread_t writer;
+} Telemetry;
+Telemetry g_telemetry;
+
+// the values of one record, in column order
+static void telemetryRow(const TelemetryRecord *rec, int64_t *row) {
+  int c = 0;
+  row[c++] = rec->frame;
+  row[c++] = rec->stats.alive;
+  for (int t = 0; t < NBR_TRAITS; ++t) {
+    row[c++] = rec->stats.sum[t];
+    row[c++] = rec->stats.sumSq[t];
+    for (int b = 0; b < TRAIT_BINS; ++b)
+      row[c++] = rec->stats.hist[t][b];
+  }
+}
+
+static void telemetryNames(char names[][TELEMETRY_NAME_SIZE]) {
+  int c = 0;
+  snprintf(names[c++], TELEMETRY_NAME_SIZE, "frame");
+  snprintf(names[c++], TELEMETRY_NAME_SIZE, "alive");
+  for (int t = 0; t < NBR_TRAITS; ++t) {
+    snprintf(names[c++], TELEMETRY_NAME_SIZE, "%s_sum", TRAIT_NAMES[t]);
+    snprintf(names[c++], TELEMETRY_NAME_SIZE, "%s_sumsq", TRAIT_NAMES[t]);
+    for (int b = 0; b < TRAIT_BINS; ++b)
+      snprintf(names[c++], TELEMETRY_NAME_SIZE, "%s_bin%d", TRAIT_NAMES[t],
+               b);
+  }
+}
+
+// write one column of a block; out needs room for 10 bytes a row
+static void writeTelemetryColumn(const int64_t *column, u_int32_t rows,
+                                 unsigned char *out) {
+  u_int32_t size = 0;
+  int64_t last = 0;
+  for (u_int32_t r = 0; r < rows; ++r) {
+    u_int64_t delta = (u_int64_t)column[r] - last;
+    u_int64_t zigzag = delta << 1 ^ -(delta >> 63);
+    last = column[r];
+    while (zigzag >= 0x80) {
+      out[size++] = zigzag | 0x80;
+      zigzag >>= 7;
+    }
+    out[size++] = zigzag;
+  }
+  fwrite(&size, sizeof(size), 1, g_telemetry.file);
+  fwrite(out, 1, size, g_telemetry.file);
+}
+
+static void writeTelemetryBlock(int64_t (*block)[TELEMETRY_BLOCK_ROWS],
+                                u_int32_t rows, unsigned char *out) {
+  fwrite(&rows, sizeof(rows), 1, g_telemetry.file);
+  for (int c = 0; c < TELEMETRY_COLUMNS; ++c)
+    writeTelemetryColumn(block[c], rows, out);
+}
+
+static void *telemetryWriter(void *arg) {
+  (void)arg;
+  int64_t(*block)[TELEMETRY_BLOCK_ROWS] =
+      malloc(sizeof(int64_t) * TELEMETRY_COLUMNS * TELEMETRY_BLOCK_ROWS);
+  unsigned char *out = malloc(10 * TELEMETRY_BLOCK_ROWS);
+  if (block == NULL || out == NULL) {
+    perror("Error: Unable to allocate memory for telemetry");
+    exit(1);
+  }
+  u_int32_t rows = 0;
+  for (;;) {
+    // done is set after the last push, so the head read after it has
+    // every record
+    int done = __atomic_load_n(&g_telemetry.done, __ATOMIC_ACQUIRE);
+    u_int64_t head = __atomic_load_n(&g_telemetry.head, __ATOMIC_ACQUIRE);
+    while (g_telemetry.tail != head) {
+      int64_t row[TELEMETRY_COLUMNS];
+      telemetryRow(&g_telemetry.ring[g_telemetry.tail & (TELEMETRY_RING - 1)],
+                   row);
+      __atomic_store_n(&g_telemetry.tail, g_telemetry.tail + 1,
+                       __ATOMIC_RELEASE);
+      for (int c = 0; c < TELEMETRY_COLUMNS; ++c)
+        block[c][rows] = row[c];
+      if (++rows == TELEMETRY_BLOCK_ROWS) {
+        writeTelemetryBlock(block, rows, out);
+        rows = 0;
+      }
+    }
+    if (done)
+      break;
+    usleep(1000);
+  }
+  if (rows > 0)
+    writeTelemetryBlock(block, rows, out);
+  free(block);
+  free(out);
+  return NULL;
+}
+
+void openTelemetry(const char *name) {
+  g_telemetry.file = fopen(name, "wb");
+  g_telemetry.ring = malloc(TELEMETRY_RING * sizeof(TelemetryRecord));
+  if (g_telemetry.file == NULL || g_telemetry.ring == NULL) {
+    perror("Error: Unable to open telemetry file");
+    exit(1);
+  }
+  TelemetryHeader header = {.magic = TELEMETRY_MAGIC,
+                            .version = TELEMETRY_VERSION,
+                            .columns = TELEMETRY_COLUMNS};
+  char names[TELEMETRY_COLUMNS][TELEMETRY_NAME_SIZE] = {{0}};
+  telemetryNames(names);
+  fwrite(&header, sizeof(header), 1, g_telemetry.file);
+  fwrite(names, sizeof(names), 1, g_telemetry.file);
+  pthread_create(&g_telemetry.writer, NULL, telemetryWriter, NULL);
+}
+
+void closeTelemetry(void) {
+  if (g_telemetry.file == NULL)
+    return;
+  __atomic_store_n(&g_telemetry.done, 1, __ATOMIC_RELEASE);
+  pthread_join(g_telemetry.writer, NULL);
+  if (fclose(g_telemetry.file) != 0)
+    perror("Error: Unable to write telemetry file");
+  if (g_telemetry.dropped)
+    printf("Telemetry: dropped %lu records the writer couldn't keep up "
+           "with\n",
+           g_telemetry.dropped);
+  free(g_telemetry.ring);
+  g_telemetry.file = NULL;
+}
+
+static void pushTelemetry(u_int64_t frame) {
+  u_int64_t head = g_telemetry.head;
+  if (head - __atomic_load_n(&g_telemetry.tail, __ATOMIC_ACQUIRE) ==
+      TELEMETRY_RING) {
+    ++g_telemetry.dropped;
+    return;
+  }
+  TelemetryRecord *rec = &g_telemetry.ring[head & (TELEMETRY_RING - 1)];
+  rec->frame = frame;
+  rec->stats = g_stats;
+  __atomic_store_n(&g_telemetry.head, head + 1, __ATOMIC_RELEASE);
+}
+
+// decode one column of a block; returns 0 if it runs past its bytes
+static int readTelemetryColumn(FILE *fp, int64_t *column, u_int32_t rows,
+                               unsigned char *in) {
+  u_int32_t size;
+  if (fread(&size, sizeof(size), 1, fp) != 1 || size > 10 * rows ||
+      fread(in, 1, size, fp) != size)
+    return 0;
+  u_int32_t at = 0;
+  int64_t last = 0;
+  for (u_int32_t r = 0; r < rows; ++r) {
+    u_int64_t zigzag = 0;
+    for (int shift = 0;; shift += 7) {
+      if (at == size || shift > 63)
+        return 0;
+      zigzag |= (u_int64_t)(in[at] & 0x7f) << shift;
+      if (!(in[at++] & 0x80))
+        break;
+    }
+    last += (int64_t)(zigzag >> 1 ^ -(zigzag & 1));
+    column[r] = last;
+  }
+  return at == size;
+}
+
+// print a telemetry file as CSV, one line per status frame
+int telemetryToCsv(const char *name, FILE *out) {
+  FILE *fp = fopen(name, "rb");
+  if (fp == NULL) {
+    perror("Error: Unable to open telemetry file");
+    return 0;
+  }
+  TelemetryHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, TELEMETRY_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TELEMETRY_VERSION || header.columns == 0 ||
+      header.columns > 4096) {
+    printf("Error: %s is not a telemetry file\n", name);
+    fclose(fp);
+    return 0;
+  }
+  char(*names)[TELEMETRY_NAME_SIZE] =
+      malloc(header.columns * TELEMETRY_NAME_SIZE);
+  int64_t(*block)[TELEMETRY_BLOCK_ROWS] =
+      malloc(sizeof(int64_t) * header.columns * TELEMETRY_BLOCK_ROWS);
+  unsigned char *in = malloc(10 * TELEMETRY_BLOCK_ROWS);
+  int ok = names && block && in &&
+           fread(names, TELEMETRY_NAME_SIZE, header.columns, fp) ==
+               header.columns;
+  for (u_int32_t c = 0; ok && c < header.columns; ++c) {
+    names[c][TELEMETRY_NAME_SIZE - 1] = '\0';
+    fprintf(out, c ? ",%s" : "%s", names[c]);
+  }
+  fprintf(out, "\n");
+  u_int32_t rows;
+  while (ok && fread(&rows, sizeof(rows), 1, fp) == 1) {
+    ok = rows > 0 && rows <= TELEMETRY_BLOCK_ROWS;
+    for (u_int32_t c = 0; ok && c < header.columns; ++c)
+      ok = readTelemetryColumn(fp, block[c], rows, in);
+    for (u_int32_t r = 0; ok && r < rows; ++r) {
+      for (u_int32_t c = 0; c < header.columns; ++c)
+        fprintf(out, c ? ",%ld" : "%ld", block[c][r]);
+      fprintf(out, "\n");
+    }
+  }
+  if (!ok)
+    printf("Error: %s is truncated or corrupt\n", name);
+  free(names);
+  free(block);
+  free(in);
+  fclose(fp);
+  return ok;
+}
+
+// A capture (--capture) is a video of the run made without the window, so
+// it goes at the speed of the simulation rather than of the display. Every
+// --capture-every frames the simulation paints the world into the next of
+// CAPTURE_BUFFERS buffers, and an encoder thread of its own turns them
+// into frames of the output and writes them out. As with the telemetry, a
+// frame that finds every buffer still waiting for the encoder is dropped
+// (and counted) rather than waited for, so memory stays at the buffers.
+//
+// The format follows the name: .ppm is one binary PPM after another, .y4m
+// YUV4MPEG2 (4:4:4, CAPTURE_FPS frames a second) and anything else raw
+// 8-bit RGB. A name starting with | is a command, an encoder such as
+// ffmpeg, that is given Y4M on its standard input. Cells are drawn over
+// black, as in the window.
+#define CAPTURE_BUFFERS 8
+#define CAPTURE_FPS 30
+
+typedef enum { CAPTURE_RAW, CAPTURE_PPM, CAPTURE_Y4M } CAPTURE_FORMAT;
+
+typedef struct Capture {
+  FILE *file;
+  int pipe; // file is a command's standard input
+  CAPTURE_FORMAT format;
+  u_int64_t every;
+  Color *buffer[CAPTURE_BUFFERS];
+  u_int64_t head;    // frames painted, written by the simulation only
+  u_int64_t tail;    // frames encoded, written by the encoder only
+  u_int64_t dropped; // frames there was no buffer for
+  int done, failed;
+  pthread_t encoder;
+} Capture;
+Capture g_capture = {.every = 1};
+
+// one painted frame to the output's bytes; out needs 3 bytes a cell
+static size_t encodeCapture(const Color *pixels, unsigned char *out) {
+  size_t cells = (size_t)WORLD_WIDTH * WORLD_HEIGHT, size = 0;
+  if (g_capture.format == CAPTURE_PPM)
+    size = sprintf((char *)out, "P6\n%d %d\n255\n", WORLD_WIDTH,
+                   WORLD_HEIGHT);
+  else if (g_capture.format == CAPTURE_Y4M)
+    size = sprintf((char *)out, "FRAME\n");
+  unsigned char *plane = out + size;
+  for (size_t i = 0; i < cells; ++i) {
+    int r = pixels[i].r * pixels[i].a / 255;
+    int g = pixels[i].g * pixels[i].a / 255;
+    int b = pixels[i].b * pixels[i].a / 255;
+    if (g_capture.format != CAPTURE_Y4M) {
+      plane[3 * i] = r;
+      plane[3 * i + 1] = g;
+      plane[3 * i + 2] = b;
+      continue;
+    }
+    // BT.601, studio range
+    plane[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    plane[cells + i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    plane[2 * cells + i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+  return size + 3 * cells;
+}
+
+static void *captureEncoder(void *arg) {
+  (void)arg;
+  unsigned char *out = malloc((size_t)WORLD_WIDTH * WORLD_HEIGHT * 3 + 64);
+  if (out == NULL) {
+    perror("Error: Unable to allocate memory for the capture");
+    exit(1);
+  }
+  for (;;) {
+    // done is set after the last push, so the head read after it has
+    // every frame
+    int done = __atomic_load_n(&g_capture.done, __ATOMIC_ACQUIRE);
+    u_int64_t head = __atomic_load_n(&g_capture.head, __ATOMIC_ACQUIRE);
+    while (g_capture.tail != head) {
+      size_t size = encodeCapture(
+          g_capture.buffer[g_capture.tail % CAPTURE_BUFFERS], out);
+      __atomic_store_n(&g_capture.tail, g_capture.tail + 1, __ATOMIC_RELEASE);
+      if (!g_capture.failed &&
+          fwrite(out, 1, size, g_capture.file) != size)
+        g_capture.failed = 1; // keep taking frames, so none wait
+    }
+    if (done)
+      break;
+    usleep(1000);
+  }
+  free(out);
+  return NULL;
+}
+
+void openCapture(const char *name, u_int64_t every) {
+  size_t length = strlen(name);
+  if (name[0] == '|') {
+    // an encoder that quits early is reported when the capture closes
+    signal(SIGPIPE, SIG_IGN);
+    g_capture.file = popen(name + 1, "w");
+    g_capture.pipe = 1;
+    g_capture.format = CAPTURE_Y4M;
+  } else {
+    g_capture.file = fopen(name, "wb");
+    if (length >= 4 && strcmp(name + length - 4, ".ppm") == 0)
+      g_capture.format = CAPTURE_PPM;
+    else if (length >= 4 && strcmp(name + length - 4, ".y4m") == 0)
+      g_capture.format = CAPTURE_Y4M;
+  }
+  if (g_capture.file == NULL) {
+    perror("Error: Unable to open capture file");
+    exit(1);
+  }
+  for (int b = 0; b < CAPTURE_BUFFERS; ++b) {
+    g_capture.buffer[b] =
+        malloc((size_t)WORLD_WIDTH * WORLD_HEIGHT * sizeof(Color));
+    if (g_capture.buffer[b] == NULL) {
+      perror("Error: Unable to allocate memory for the capture");
+      exit(1);
+    }
+  }
+  g_capture.every = every ? every : 1;
+  if (g_capture.format == CAPTURE_Y4M)
+    fprintf(g_capture.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+            WORLD_WIDTH, WORLD_HEIGHT, CAPTURE_FPS);
+  pthread_create(&g_capture.encoder, NULL, captureEncoder, NULL);
+}
+
+void closeCapture(void) {
+  if (g_capture.file == NULL)
+    return;
+  __atomic_store_n(&g_capture.done, 1, __ATOMIC_RELEASE);
+  pthread_join(g_capture.encoder, NULL);
+  int failed = g_capture.failed;
+  if (g_capture.pipe) {
+    int status = pclose(g_capture.file);
+    failed |= status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  } else {
+    failed |= fclose(g_capture.file) != 0;
+  }
+  if (failed)
+    printf("Error: Unable to write the capture\n");
+  if (g_capture.dropped)
+    printf("Capture: dropped %lu frames the encoder couldn't keep up with\n",
+           g_capture.dropped);
+  for (int b = 0; b < CAPTURE_BUFFERS; ++b)
+    free(g_capture.buffer[b]);
+  g_capture.file = NULL;
+}
+
+static void pushCapture(u_int64_t frame) {
+  if (frame % g_capture.every != 0)
+    return;
+  u_int64_t head = g_capture.head;
+  if (head - __atomic_load_n(&g_capture.tail, __ATOMIC_ACQUIRE) ==
+      CAPTURE_BUFFERS) {
+    ++g_capture.dropped;
+    return;
+  }
+  renderWorld(g_capture.buffer[head % CAPTURE_BUFFERS]);
+  __atomic_store_n(&g_capture.head, head + 1, __ATOMIC_RELEASE);
+}
+
+// A recording (--record) is the run as a stream of what happened in it, to
+// look at again or analyse (--replay) without simulating it again: every
+// move, death, fight and birth, the squares addFood puts down, the cells
+// regenerate turns to food or poison, and compactions. Every
+// RECORD_KEYFRAME_EVERY frames it also holds the whole world, so a replay
+// can start anywhere by going to the keyframe before and playing on.
+//
+// The file is a RecordHeader and then records: a kind, the frame and the
+// byte length, then the bytes. A keyframe is the world before its frame is
+// simulated, a frame record that frame's events in the order they took
+// effect. At the end are the keyframes' (frame, offset) pairs and a
+// RecordTrailer. Numbers are varints as in the telemetry, and slots and
+// cells are mostly differences from the last, so a move is three bytes.
+#define RECORD_MAGIC "BUGRECD"
+#define RECORD_INDEX_MAGIC "BUGRIDX"
+#define RECORD_VERSION 1
+#define RECORD_KEYFRAME_EVERY 256
+#define RECORD_KEYFRAME 'K'
+#define RECORD_FRAME 'F'
+
+// A move is its step, (dx + 3) * 7 + dy + 3 (the speed is at most 3), the
+// slot less the last move's, and the health the bug was left with
+enum {
+  EV_TILE = 49, // the moves after it count their slots from 0 again
+  EV_DEATH,     // slot
+  EV_FIGHT,     // winner, loser
+  EV_BIRTH,     // slot, mother, father, x, y, DNA
+  EV_FOOD,      // x, y, width, height
+  EV_REGENERATE, // per cell: cells since the last * 2 + is poison; then 0
+  EV_COMPACT,
+  EV_SORT, // a compaction into Morton order
+};
+
+typedef struct RecordHeader {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t width, height;
+  u_int32_t keyframeEvery;
+  u_int64_t seed;
+} RecordHeader;
+
+typedef struct RecordTrailer {
+  u_int64_t indexAt, keyframes;
+  u_int64_t end; // one past the last frame
+  char magic[8];
+} RecordTrailer;
+
+typedef struct Recorder {
+  FILE *file;
+  EventBuf frame;   // the events that aren't a tile's, and then all of them
+  EventBuf key;     // the keyframe being written
+  u_int64_t *index; // frame, offset
+  size_t keyframes, indexCapacity;
+  u_int64_t end;
+} Recorder;
+Recorder g_record;
+
+static void growEvents(EventBuf *buf, size_t more) {
+  if (buf->size + more <= buf->capacity)
+    return;
+  size_t capacity = buf->capacity ? buf->capacity : 4096;
+  while (capacity < buf->size + more)
+    capacity *= 2;
+  // in memory the --procs helpers share, as tiles record there
+  buf->data = sharedRealloc(buf->data, capacity);
+  if (buf->data == NULL) {
+    perror("Error: Unable to allocate memory for the recording");
+    exit(1);
+  }
+  buf->capacity = capacity;
+}
+
+static inline void putByte(EventBuf *buf, unsigned char byte) {
+  growEvents(buf, 1);
+  buf->data[buf->size++] = byte;
+}
+
+// returns the number of bytes, at most 10
+static inline int varintTo(unsigned char *out, u_int64_t value) {
+  int n = 0;
+  while (value >= 0x80) {
+    out[n++] = value | 0x80;
+    value >>= 7;
+  }
+  out[n++] = value;
+  return n;
+}
+
+static inline void putVarint(EventBuf *buf, u_int64_t value) {
+  growEvents(buf, 10);
+  buf->size += varintTo(buf->data + buf->size, value);
+}
+
+static inline void putSigned(EventBuf *buf, int64_t value) {
+  putVarint(buf, (u_int64_t)value << 1 ^ -((u_int64_t)value >> 63));
+}
+
+// bug i moved off from; its health goes in once it has landed
+static void recordMove(StepCtx *ctx, int i, u_int64_t from) {
+  EventBuf *buf = &ctx->events;
+  int dx = g_bugs.x[i] - cellX(from), dy = g_bugs.y[i] - cellY(from);
+  // across the edge
+  if (dx > 3)
+    dx -= WORLD_WIDTH;
+  else if (dx < -3)
+    dx += WORLD_WIDTH;
+  if (dy > 3)
+    dy -= WORLD_HEIGHT;
+  else if (dy < -3)
+    dy += WORLD_HEIGHT;
+  putByte(buf, (dx + 3) * 7 + dy + 3);
+  putSigned(buf, i - buf->lastSlot);
+  buf->lastSlot = i;
+  buf->healthAt = buf->size;
+  putByte(buf, 0);
+}
+
+static inline void recordLanded(StepCtx *ctx, int i) {
+  ctx->events.data[ctx->events.healthAt] = g_bugs.health[i];
+}
+
+static void recordFight(EventBuf *buf, int winner, int loser) {
+  putByte(buf, EV_FIGHT);
+  putVarint(buf, winner);
+  putVarint(buf, loser);
+}
+
+static void recordDeath(EventBuf *buf, int idx) {
+  putByte(buf, EV_DEATH);
+  putVarint(buf, idx);
+}
+
+static void recordBirth(EventBuf *buf, int baby, int mom, int dad) {
+  putByte(buf, EV_BIRTH);
+  putVarint(buf, baby);
+  putVarint(buf, mom);
+  putVarint(buf, dad);
+  putVarint(buf, g_bugs.x[baby]);
+  putVarint(buf, g_bugs.y[baby]);
+  putVarint(buf, g_bugs.dna[baby]);
+}
+
+// append a tile's events to the frame's
+static void takeEvents(EventBuf *events) {
+  if (events->size == 0)
+    return;
+  putByte(&g_record.frame, EV_TILE);
+  growEvents(&g_record.frame, events->size);
+  memcpy(g_record.frame.data + g_record.frame.size, events->data,
+         events->size);
+  g_record.frame.size += events->size;
+  events->size = 0;
+  events->lastSlot = 0;
+}
+
+static void writeRecord(int kind, u_int64_t frame, const EventBuf *buf) {
+  unsigned char head[21];
+  int n = 0;
+  head[n++] = kind;
+  n += varintTo(head + n, frame);
+  n += varintTo(head + n, buf->size);
+  fwrite(head, 1, n, g_record.file);
+  fwrite(buf->data, 1, buf->size, g_record.file);
+}
+
+// the world before frame: the live bugs, then the cells in row order as
+// runs of the same word
+static void recordKeyframe(u_int64_t frame) {
+  EventBuf *key = &g_record.key;
+  key->size = 0;
+  putVarint(key, g_bugs.count);
+  putVarint(key, g_bugs.live);
+  int last = -1;
+  FOR_EACH_LIVE_BUG(i) {
+    putVarint(key, i - last);
+    putVarint(key, g_bugs.x[i]);
+    putVarint(key, g_bugs.y[i]);
+    putVarint(key, g_bugs.dna[i]);
+    last = i;
+  }
+  u_int32_t word = EMPTY;
+  u_int64_t run = 0;
+  for (int y = 0; y < WORLD_HEIGHT; ++y) {
+    for (int x = 0, n; x < WORLD_WIDTH; x += n) {
+      n = WORLD_WIDTH - x;
+      const u_int32_t *cell = cellRun(x, y, &n);
+#ifdef CHUNKED_WORLD
+      if (word == EMPTY && chunkOf(cellPos(x, y)) == &g_emptyChunk) {
+        run += n;
+        continue;
+      }
+#endif
+      for (int k = 0; k < n; ++k) {
+        if (cell[k] == word) {
+          ++run;
+          continue;
+        }
+        if (run) {
+          putVarint(key, word);
+          putVarint(key, run);
+        }
+        word = cell[k];
+        run = 1;
+      }
+    }
+  }
+  putVarint(key, word);
+  putVarint(key, run);
+
+  if (g_record.keyframes == g_record.indexCapacity) {
+    g_record.indexCapacity =
+        g_record.indexCapacity ? g_record.indexCapacity * 2 : 64;
+    g_record.index =
+        realloc(g_record.index, g_record.indexCapacity * 2 * sizeof(u_int64_t));
+    if (g_record.index == NULL) {
+      perror("Error: Unable to allocate memory for the recording");
+      exit(1);
+    }
+  }
+  g_record.index[2 * g_record.keyframes] = frame;
+  g_record.index[2 * g_record.keyframes + 1] = ftell(g_record.file);
+  ++g_record.keyframes;
+  writeRecord(RECORD_KEYFRAME, frame, key);
+  // anything recorded before it, e.g. while the world was made, is in it
+  g_record.frame.size = 0;
+}
+
+void openRecord(const char *name) {
+  g_record.file = fopen(name, "wb");
+  if (g_record.file == NULL) {
+    perror("Error: Unable to open recording file");
+    exit(1);
+  }
+  RecordHeader header = {.magic = RECORD_MAGIC,
+                         .version = RECORD_VERSION,
+                         .width = WORLD_WIDTH,
+                         .height = WORLD_HEIGHT,
+                         .keyframeEvery = RECORD_KEYFRAME_EVERY,
+                         .seed = g_seed};
+  fwrite(&header, sizeof(header), 1, g_record.file);
+}
+
+// called before a frame is simulated
+static void recordFrameStart(u_int64_t frame) {
+  if (g_record.keyframes == 0 || frame % RECORD_KEYFRAME_EVERY == 0)
+    recordKeyframe(frame);
+}
+
+// called once it has been
+static void recordFrameEnd(u_int64_t frame) {
+  writeRecord(RECORD_FRAME, frame, &g_record.frame);
+  g_record.frame.size = 0;
+  g_record.end = frame + 1;
+}
+
+void closeRecord(void) {
+  if (g_record.file == NULL)
+    return;
+  RecordTrailer trailer = {.indexAt = ftell(g_record.file),
+                           .keyframes = g_record.keyframes,
+                           .end = g_record.end,
+                           .magic = RECORD_INDEX_MAGIC};
+  fwrite(g_record.index, 2 * sizeof(u_int64_t), g_record.keyframes,
+         g_record.file);
+  fwrite(&trailer, sizeof(trailer), 1, g_record.file);
+  if (fclose(g_record.file) != 0)
+    perror("Error: Unable to write recording file");
+  free(g_record.index);
+  sharedFree(g_record.frame.data);
+  sharedFree(g_record.key.data);
+  g_record.file = NULL;
+}
+
+// what is taken of the world after each frame is simulated or replayed,
+// unlike the status line, which also has a line for the world before the
+// first frame
+static void takeSnapshots(u_int64_t frame) {
+  if (g_capture.file)
+    pushCapture(frame);
+  if (g_censusFile && frame % g_censusEvery == 0)
+    writeCensus(frame);
+}
+
+void updateStatusLine(u_int64_t frame, FILE *ofp) {
+  double alive = g_stats.alive;
+  if (frame % g_statsEvery != 0)
+    return;
+  if (g_telemetry.file)
+    pushTelemetry(frame);
+  if (ofp == NULL)
+    return;
+  fprintf(ofp, "%.0f\t%lu", alive, frame);
+  for (int t = 0; t < NBR_TRAITS; ++t)
+    fprintf(ofp, "\t%.2f", g_stats.sum[t] / alive);
+  if (g_statsDetail) {
+    // standard deviations, then the histogram of each trait
+    for (int t = 0; t < NBR_TRAITS; ++t) {
+      double mean = g_stats.sum[t] / alive;
+      double var = g_stats.sumSq[t] / alive - mean * mean;
+      fprintf(ofp, "\t%.2f", var > 0 ? sqrt(var) : 0.0);
+    }
+    for (int t = 0; t < NBR_TRAITS; ++t) {
+      fprintf(ofp, "\t");
+      for (int b = 0; b < TRAIT_BINS; ++b)
+        fprintf(ofp, b ? ",%d" : "%d", g_stats.hist[t][b]);
+    }
+  }
+  fprintf(ofp, "\n");
+}
+
+// a bug's draws for this frame
+static inline RngBlock moveDraws(StepCtx *ctx, int idx) {
+  if (idx < g_moveDrawCount)
+    return g_moveDraws[idx];
+  return rngBlock(ctx->frame, idx, RNG_MOVE);
+}
+
+u_int64_t bugMove(StepCtx *ctx, int idx) {
+  // look around based on vision
+  // the resources left, right, up and down from the bug will determine the
+  // probability of moving in that direction
+  //
+  RngBlock draw = moveDraws(ctx, idx);
+  // Move bugs randomly if they have 0 vision
+  if (g_bugs.vision[idx] == 0) {
+    g_bugs.x[idx] += (draw.v[0] % 3) - 1;
+    g_bugs.y[idx] += (draw.v[1] % 3) - 1;
+  } else {
+    // if the bug has 1  or greater vision it can see the resources around it
+    int left_prob = 0, up_prob = 0;
+    getMovementProbabilities(idx, &left_prob, &up_prob);
+    int x_dir = 0;
+    if ((int)(draw.v[0] % 100) < left_prob) {
+      x_dir = -1 * g_bugs.speed[idx];
+    } else {
+      x_dir = g_bugs.speed[idx];
+    }
+    int y_dir = 0;
+    if ((int)(draw.v[1] % 100) < up_prob) {
+      y_dir = -1 * g_bugs.speed[idx];
+    } else {
+      y_dir = g_bugs.speed[idx];
+    }
+    g_bugs.x[idx] += x_dir;
+    g_bugs.y[idx] += y_dir;
+  }
+
+  // Wrap around screen
+  if (g_bugs.x[idx] < 0)
+    g_bugs.x[idx] = WORLD_WIDTH - 1;
+  if (g_bugs.x[idx] >= WORLD_WIDTH)
+    g_bugs.x[idx] = 0;
+  if (g_bugs.y[idx] < 0)
+    g_bugs.y[idx] = WORLD_HEIGHT - 1;
+  if (g_bugs.y[idx] >= WORLD_HEIGHT)
+    g_bugs.y[idx] = 0;
+
+  if (draw.v[2] % 100 < MOVE_COST_PROB * 100) {
+    if (g_bugs.health[idx] <= MOVE_COST) {
+      setHealth(ctx, idx, 0);
+    } else
+      setHealth(ctx, idx, g_bugs.health[idx] - MOVE_COST);
+  }
+  return cellPos(g_bugs.x[idx], g_bugs.y[idx]);
+}
+
+// the packed count contributed by one cell of the given type
+static inline u_int64_t typeUnit(WORLDCELL_TYPE type) {
+  switch (type) {
+  case FOOD:
+    return 1;
+  case POISON:
+    return 1ull << COUNT_BITS;
+  case BUG:
+    return 1ull << (2 * COUNT_BITS);
+  default:
+    return 0;
+  }
+}
+
+static inline int freeBlockOf(int x, int y) {
+  return y / FREE_BLOCK_SIZE * g_freeBlocksAcross + x / FREE_BLOCK_SIZE;
+}
+
+#ifdef CHUNKED_WORLD
+// the count of EMPTY cells in the block holding cell (x, y)
+static inline u_int16_t *freeCountAt(int x, int y) {
+  Chunk *chunk = chunkOf(cellPos(x, y));
+  return &chunk->freeCount[y % CHUNK_SIZE / FREE_BLOCK_SIZE * CHUNK_BLOCKS +
+                           x % CHUNK_SIZE / FREE_BLOCK_SIZE];
+}
+
+// the number of cells of the world in the block at (bx, by), which is cut
+// short at the world's far edges
+static int blockCells(int bx, int by) {
+  int w = WORLD_WIDTH - bx, h = WORLD_HEIGHT - by;
+  // blocks of an edge chunk that lie past the edge have none
+  if (w <= 0 || h <= 0)
+    return 0;
+  return (w < FREE_BLOCK_SIZE ? w : FREE_BLOCK_SIZE) *
+         (h < FREE_BLOCK_SIZE ? h : FREE_BLOCK_SIZE);
+}
+
+// the chunk holding pos, allocated (all EMPTY) if it isn't yet. Tiles may
+// reach into the same chunk, so the first one to put it in the directory
+// wins and the others use theirs
+static Chunk *writableChunk(u_int64_t pos) {
+  Chunk **slot = &g_chunks[pos >> CHUNK_CELL_BITS];
+  Chunk *chunk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (chunk != &g_emptyChunk)
+    return chunk;
+  Chunk *fresh = calloc(1, sizeof(Chunk));
+  if (fresh == NULL) {
+    perror("Error: Unable to allocate memory for a world chunk\n");
+    exit(1);
+  }
+  int x0 = cellX(pos) & ~(CHUNK_SIZE - 1), y0 = cellY(pos) & ~(CHUNK_SIZE - 1);
+  for (int b = 0; b < CHUNK_BLOCKS * CHUNK_BLOCKS; ++b)
+    fresh->freeCount[b] = blockCells(x0 + b % CHUNK_BLOCKS * FREE_BLOCK_SIZE,
+                                     y0 + b / CHUNK_BLOCKS * FREE_BLOCK_SIZE);
+  if (!__atomic_compare_exchange_n(slot, &chunk, fresh, 0, __ATOMIC_ACQ_REL,
+                                   __ATOMIC_ACQUIRE)) {
+    free(fresh);
+    return chunk;
+  }
+  __atomic_add_fetch(&g_chunksInUse, 1, __ATOMIC_RELAXED);
+  return fresh;
+}
+
+// set up an all EMPTY world
+void allocWorld(void) {
+  g_chunksAcross = (WORLD_WIDTH + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  g_chunksDown = (WORLD_HEIGHT + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  g_chunks = malloc(sizeof(Chunk *) * g_chunksAcross * g_chunksDown);
+  if (g_chunks == NULL) {
+    printf("Error: Unable to allocate memory for the world chunks\n");
+    exit(1);
+  }
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown; ++c)
+    g_chunks[c] = &g_emptyChunk;
+  // only ever compared with 0: every block of the empty chunk has room
+  for (int b = 0; b < CHUNK_BLOCKS * CHUNK_BLOCKS; ++b)
+    g_emptyChunk.freeCount[b] = 1;
+}
+
+void freeWorld(void) {
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown; ++c)
+    if (g_chunks[c] != &g_emptyChunk)
+      free(g_chunks[c]);
+  free(g_chunks);
+}
+
+// make every cell EMPTY again; the free blocks need rebuilding after
+void clearWorld(void) {
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown; ++c) {
+    if (g_chunks[c] != &g_emptyChunk)
+      free(g_chunks[c]);
+    g_chunks[c] = &g_emptyChunk;
+  }
+  g_chunksInUse = 0;
+}
+
+// give back the chunks that have emptied, between frames
+void trimChunks(void) {
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown; ++c) {
+    Chunk *chunk = g_chunks[c];
+    if (chunk == &g_emptyChunk)
+      continue;
+    int x0 = c % g_chunksAcross * CHUNK_SIZE, y0 = c / g_chunksAcross * CHUNK_SIZE;
+    int b = 0;
+    while (b < CHUNK_BLOCKS * CHUNK_BLOCKS &&
+           chunk->freeCount[b] ==
+               blockCells(x0 + b % CHUNK_BLOCKS * FREE_BLOCK_SIZE,
+                          y0 + b / CHUNK_BLOCKS * FREE_BLOCK_SIZE))
+      ++b;
+    if (b < CHUNK_BLOCKS * CHUNK_BLOCKS)
+      continue;
+    g_chunks[c] = &g_emptyChunk;
+    free(chunk);
+    --g_chunksInUse;
+  }
+}
+#else
+static inline u_int16_t *freeCountAt(int x, int y) {
+  return &g_freeBlocks[freeBlockOf(x, y)];
+}
+
+void allocWorld(void) {
+  g_worldCell =
+      sharedCalloc((size_t)WORLD_WIDTH * WORLD_HEIGHT, sizeof(u_int32_t));
+  if (g_worldCell == NULL) {
+    printf("Error: Unable to allocate memory for g_worldCell\n");
+    exit(1);
+  }
+}
+
+void freeWorld(void) {
+  sharedFree(g_worldCell);
+  sharedFree(g_freeBlocks);
+}
+
+void clearWorld(void) {
+  memset(g_worldCell, 0,
+         (size_t)WORLD_WIDTH * WORLD_HEIGHT * sizeof(u_int32_t));
+}
+#endif
+
+// every write to a cell goes through here so the summed-area table and the
+// free block counts stay in step with the world
+static void setCell(u_int64_t screen_pos, WORLDCELL_TYPE type, int idx) {
+  WORLDCELL_TYPE old = cellType(screen_pos);
+#ifdef CHUNKED_WORLD
+  if (old == EMPTY && type == EMPTY)
+    return; // nothing to write, and the chunk may be the shared empty one
+  writableChunk(screen_pos)
+      ->cell[screen_pos & ((1u << CHUNK_CELL_BITS) - 1)] =
+      (u_int32_t)idx << CELL_TYPE_BITS | type;
+#else
+  g_worldCell[screen_pos] = (u_int32_t)idx << CELL_TYPE_BITS | type;
+#endif
+  if (old == type)
+    return;
+  if (g_freeBlocksAcross && (old == EMPTY || type == EMPTY)) {
+    u_int16_t *count = freeCountAt(cellX(screen_pos), cellY(screen_pos));
+    if (g_tiles.threads)
+      __atomic_add_fetch(count, type == EMPTY ? 1 : -1, __ATOMIC_RELAXED);
+    else
+      *count += type == EMPTY ? 1 : -1;
+  }
+  if (g_typeTree == NULL)
+    return;
+  u_int64_t delta = typeUnit(type) - typeUnit(old);
+  g_typeTotal += delta;
+  for (int y = cellY(screen_pos) + 1; y <= WORLD_HEIGHT; y += y & -y)
+    for (int x = cellX(screen_pos) + 1; x <= WORLD_WIDTH; x += x & -x)
+      g_typeTree[(y - 1) * WORLD_WIDTH + x - 1] += delta;
+}
+
+void setCellType(u_int64_t screen_pos, WORLDCELL_TYPE type) {
+  setCell(screen_pos, type, 0);
+}
+
+// put bug idx on the cell
+void setCellBug(u_int64_t screen_pos, int idx) {
+  setCell(screen_pos, BUG, idx);
+}
+
+// paint the world into an RGBA frame; a bug's colour is its DNA with its
+// health as the alpha channel
+void renderWorld(Color *pixels) {
+  for (int i = 0; i < WORLD_WIDTH * WORLD_HEIGHT; ++i) {
+    u_int64_t pos = cellPos(i % WORLD_WIDTH, i / WORLD_WIDTH);
+    switch (cellType(pos)) {
+    case FOOD:
+      pixels[i] = FOOD_COLOR;
+      pixels[i].a = FOOD_OPACITY;
+      break;
+    case POISON:
+      pixels[i] = RED;
+      break;
+    case BUG: {
+      u_int32_t dna = g_bugs.dna[cellBug(pos)];
+      pixels[i] = (Color){dna >> 24 & 0xff, dna >> 16 & 0xff, dna >> 8 & 0xff,
+                          dna & 0xff};
+      break;
+    }
+    default:
+      pixels[i] = BLACK;
+    }
+  }
+}
+
+// (re)count the empty cells of every block
+void buildFreeBlocks(void) {
+  g_freeBlocksAcross = (WORLD_WIDTH + FREE_BLOCK_SIZE - 1) / FREE_BLOCK_SIZE;
+  g_freeBlocksDown = (WORLD_HEIGHT + FREE_BLOCK_SIZE - 1) / FREE_BLOCK_SIZE;
+#ifdef CHUNKED_WORLD
+  // the empty chunk's counts never change; only chunks in use are counted
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown; ++c) {
+    Chunk *chunk = g_chunks[c];
+    if (chunk == &g_emptyChunk)
+      continue;
+    int x0 = c % g_chunksAcross * CHUNK_SIZE, y0 = c / g_chunksAcross * CHUNK_SIZE;
+    memset(chunk->freeCount, 0, sizeof(chunk->freeCount));
+    for (int y = y0; y < y0 + CHUNK_SIZE && y < WORLD_HEIGHT; ++y)
+      for (int x = x0; x < x0 + CHUNK_SIZE && x < WORLD_WIDTH; ++x)
+        if (cellType(cellPos(x, y)) == EMPTY)
+          ++*freeCountAt(x, y);
+  }
+#else
+  sharedFree(g_freeBlocks);
+  g_freeBlocks =
+      sharedCalloc(g_freeBlocksAcross * g_freeBlocksDown, sizeof(u_int16_t));
+  if (g_freeBlocks == NULL) {
+    perror("Error: Unable to allocate memory for the free blocks\n");
+    exit(1);
+  }
+  for (int y = 0; y < WORLD_HEIGHT; ++y)
+    for (int x = 0; x < WORLD_WIDTH; ++x)
+      if (cellType(y * WORLD_WIDTH + x) == EMPTY)
+        ++g_freeBlocks[freeBlockOf(x, y)];
+#endif
+}
+
+// (re)build the table from the world in O(cells)
+void buildTypeTree(void) {
+  if (g_typeTree == NULL) {
+    g_typeTree = malloc(sizeof(u_int64_t) * WORLD_WIDTH * WORLD_HEIGHT);
+    if (g_typeTree == NULL) {
+      perror("Error: Unable to allocate memory for the type table\n");
+      exit(1);
+    }
+  }
+  g_typeTotal = 0;
+  for (int y = 0; y < WORLD_HEIGHT; ++y) {
+    for (int x = 0; x < WORLD_WIDTH; ++x) {
+      int i = y * WORLD_WIDTH + x;
+      g_typeTree[i] = typeUnit(cellType(cellPos(x, y)));
+      g_typeTotal += g_typeTree[i];
+    }
+  }
+  // push every node into its parent, first along rows then along columns
+  for (int y = 0; y < WORLD_HEIGHT; ++y) {
+    u_int64_t *row = &g_typeTree[y * WORLD_WIDTH];
+    for (int x = 1; x <= WORLD_WIDTH; ++x) {
+      int parent = x + (x & -x);
+      if (parent <= WORLD_WIDTH)
+        row[parent - 1] += row[x - 1];
+    }
+  }
+  for (int y = 1; y <= WORLD_HEIGHT; ++y) {
+    int parent = y + (y & -y);
+    if (parent > WORLD_HEIGHT)
+      continue;
+    for (int x = 0; x < WORLD_WIDTH; ++x)
+      g_typeTree[(parent - 1) * WORLD_WIDTH + x] +=
+          g_typeTree[(y - 1) * WORLD_WIDTH + x];
+  }
+}
+
+// packed counts of the cells in columns [0, x) and rows [0, y)
+static u_int64_t typePrefix(int x, int y) {
+  u_int64_t sum = 0;
+  for (int i = y; i > 0; i -= i & -i)
+    for (int j = x; j > 0; j -= j & -j)
+      sum += g_typeTree[(i - 1) * WORLD_WIDTH + j - 1];
+  return sum;
+}
+
+// typePrefix extended periodically to -WIDTH <= x <= 2*WIDTH (and the same
+// for y) so rectangles that wrap around the world edge need no splitting.
+// Intermediate results may underflow; the fields come out right as long as
+// the final rectangle counts are non-negative.
+static u_int64_t wrappedTypePrefix(int x, int y) {
+  int qx = 0, qy = 0;
+  if (x < 0) {
+    qx = -1;
+    x += WORLD_WIDTH;
+  } else if (x > WORLD_WIDTH) {
+    qx = 1;
+    x -= WORLD_WIDTH;
+  }
+  if (y < 0) {
+    qy = -1;
+    y += WORLD_HEIGHT;
+  } else if (y > WORLD_HEIGHT) {
+    qy = 1;
+    y -= WORLD_HEIGHT;
+  }
+  u_int64_t sum = typePrefix(x, y);
+  if (qx)
+    sum += (u_int64_t)(int64_t)qx * typePrefix(WORLD_WIDTH, y);
+  if (qy)
+    sum += (u_int64_t)(int64_t)qy * typePrefix(x, WORLD_HEIGHT);
+  if (qx && qy)
+    sum += (u_int64_t)(int64_t)(qx * qy) * g_typeTotal;
+  return sum;
+}
+
+// weighted value of a packed count, as seen by a bug that values other bugs
+// at bug_value
+static inline double packedValue(u_int64_t counts, int bug_value) {
+  return (double)(counts & COUNT_MASK) * FOOD_HEALTH -
+         (double)((counts >> COUNT_BITS) & COUNT_MASK) * POISON_COST +
+         (double)((counts >> (2 * COUNT_BITS)) & COUNT_MASK) * bug_value;
+}
+
+// the four neighbourhood sums from the summed-area table: a dozen lookups
+// whatever the bug's vision
+static void tableNeighbourhood(int idx, double *left, double *right,
+                               double *up, double *down) {
+  int x = g_bugs.x[idx], y = g_bugs.y[idx], v = g_bugs.vision[idx];
+  int value = g_bugs.aggr[idx] + g_bugs.drive[idx];
+  PROFILE_COUNT(PROF_TABLE_LOOKUPS, 12);
+  u_int64_t x0_y1 = wrappedTypePrefix(x - v, y + v + 1);
+  u_int64_t x0_y0 = wrappedTypePrefix(x - v, y - v);
+  u_int64_t x0_yc = wrappedTypePrefix(x - v, y);
+  u_int64_t x0_yn = wrappedTypePrefix(x - v, y + 1);
+  u_int64_t xc_y1 = wrappedTypePrefix(x, y + v + 1);
+  u_int64_t xc_y0 = wrappedTypePrefix(x, y - v);
+  u_int64_t xn_y1 = wrappedTypePrefix(x + 1, y + v + 1);
+  u_int64_t xn_y0 = wrappedTypePrefix(x + 1, y - v);
+  u_int64_t x1_y1 = wrappedTypePrefix(x + v + 1, y + v + 1);
+  u_int64_t x1_y0 = wrappedTypePrefix(x + v + 1, y - v);
+  u_int64_t x1_yc = wrappedTypePrefix(x + v + 1, y);
+  u_int64_t x1_yn = wrappedTypePrefix(x + v + 1, y + 1);
+
+  *left = packedValue(xc_y1 - x0_y1 - xc_y0 + x0_y0, value);
+  *right = packedValue(x1_y1 - xn_y1 - x1_y0 + xn_y0, value);
+  *up = packedValue(x1_yc - x0_yc - x1_y0 + x0_y0, value);
+  *down = packedValue(x1_y1 - x0_y1 - x1_yn + x0_yn, value);
+}
+
+// count the cells of each type in columns [x0, x1] of row y, which may run
+// off either edge of the world
+static inline void countRow(int x0, int x1, int y, int *counts) {
+  while (x0 <= x1) {
+    int x = wrapCoord(x0, WORLD_WIDTH);
+    int n = x1 - x0 + 1;
+    if (n > WORLD_WIDTH - x)
+      n = WORLD_WIDTH - x;
+    const u_int32_t *cell = cellRun(x, y, &n);
+    for (int k = 0; k < n; ++k)
+      ++counts[cell[k] & CELL_TYPE_MASK];
+    x0 += n;
+  }
+}
+
+// sum up the resources to the left, right, up and down from the bug
+// by summing up values of each resource type
+//
+// visits every cell the bug can see, a row at a time; used for
+// short-sighted bugs, and by the tiled step and the chunked world, which
+// have no summed-area table
+static void scanNeighbourhood(int idx, double *left, double *right,
+                              double *up, double *down) {
+  int bug_x = g_bugs.x[idx], bug_y = g_bugs.y[idx];
+  int vision = g_bugs.vision[idx];
+  int bug_value = g_bugs.aggr[idx] + g_bugs.drive[idx];
+  PROFILE_COUNT(PROF_VISION_CELLS, (2 * vision + 1) * (2 * vision + 1));
+
+  // cells of each type left of, in line with and right of the bug, for
+  // the rows above, the bug's own row and the rows below
+  int counts[3][3][4] = {{{0}}};
+  for (int dy = -vision; dy <= vision; ++dy) {
+    int y = wrapCoord(bug_y + dy, WORLD_HEIGHT);
+    int (*row)[4] = counts[dy < 0 ? 0 : dy == 0 ? 1 : 2];
+    countRow(bug_x - vision, bug_x - 1, y, row[0]);
+    countRow(bug_x, bug_x, y, row[1]);
+    countRow(bug_x + 1, bug_x + vision, y, row[2]);
+  }
+  int64_t value[3][3];
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c)
+      value[r][c] = (int64_t)counts[r][c][FOOD] * FOOD_HEALTH -
+                    (int64_t)counts[r][c][POISON] * POISON_COST +
+                    (int64_t)counts[r][c][BUG] * bug_value;
+  *left += value[0][0] + value[1][0] + value[2][0];
+  *right += value[0][2] + value[1][2] + value[2][2];
+  *up += value[0][0] + value[0][1] + value[0][2];
+  *down += value[2][0] + value[2][1] + value[2][2];
+}
+
+// the softmax percentage of going towards rather than away
+static int softmaxPercent(double towards, double away) {
+  double alpha = SOFTMAX_ALPHA;
+  double weightT = exp(alpha * towards);
+  double weightA = exp(alpha * away);
+  double p = weightT / (weightT + weightA);
+  return (int)(p * 100);
+}
+
+// softmaxPercent only depends on away - towards (the values are whole
+// numbers) as long as neither weight under- or overflows and the sum isn't
+// rounding to the larger weight, so the common cases come from a table
+void buildSoftmaxTable(void) {
+  for (int d = -SOFTMAX_TABLE_RANGE; d <= SOFTMAX_TABLE_RANGE; ++d)
+    g_softmaxPercent[d + SOFTMAX_TABLE_RANGE] =
+        (int)(100 / (1 + exp(SOFTMAX_ALPHA * d)));
+}
+
+static inline int movePercent(double towards, double away) {
+  double d = away - towards;
+  if (fabs(towards) > SOFTMAX_VALUE_LIMIT || fabs(away) > SOFTMAX_VALUE_LIMIT ||
+      d < -SOFTMAX_TABLE_RANGE)
+    return softmaxPercent(towards, away);
+  if (d > SOFTMAX_TABLE_RANGE)
+    return 0;
+  return g_softmaxPercent[(int)d + SOFTMAX_TABLE_RANGE];
+}
+
+// the neighbourhood sums come from the summed-area table for far-sighted
+// bugs and from a direct scan otherwise; both give the same values
+void getMovementProbabilities(int idx, int *left_prob, int *up_prob) {
+  double left = 0, right = 0, up = 0, down = 0;
+
+  if (g_typeTree != NULL && g_bugs.vision[idx] >= SAT_MIN_VISION)
+    tableNeighbourhood(idx, &left, &right, &up, &down);
+  else
+    scanNeighbourhood(idx, &left, &right, &up, &down);
+
+  // Use softmax for horizontal and vertical probabilities.
+  // Store probabilities (scaled as percentages)
+  *left_prob = movePercent(left, right);
+  *up_prob = movePercent(up, down);
+}
+
+void bugDeath(StepCtx *ctx, int idx, u_int64_t screen_pos) {
+  if (!bugIsAlive(idx)) {
+    return;
+  }
+  countBug(&ctx->stats, idx, -1);
+  freeBugSlot(idx);
+  g_bugs.age[idx] = 0;
+  setCellType(screen_pos, EMPTY);
+  ++ctx->deaths;
+  if (g_record.file)
+    recordDeath(&ctx->events, idx);
+}
+
+int bugsAreSameSex(int idx1, int idx2) {
+  return g_bugs.sex[idx1] == g_bugs.sex[idx2] ? 1 : 0;
+}
+
+// the first empty cell on the line of n cells from (x, y) going (dx, dy),
+// wrapping around the world, or -1. Blocks without an empty cell are
+// stepped over whole
+static int64_t findEmptyOnLine(int x, int y, int dx, int dy, int n) {
+  x = wrapCoord(x, WORLD_WIDTH);
+  y = wrapCoord(y, WORLD_HEIGHT);
+  while (n > 0) {
+    if (*freeCountAt(x, y) == 0) {
+      // to the far edge of the block, which may be cut short by the world's
+      int v = dx ? x : y, size = dx ? WORLD_WIDTH : WORLD_HEIGHT;
+      int step = FREE_BLOCK_SIZE - v % FREE_BLOCK_SIZE;
+      if (step > size - v)
+        step = size - v;
+      n -= step;
+      v += step;
+      if (v == size)
+        v = 0;
+      if (dx)
+        x = v;
+      else
+        y = v;
+      continue;
+    }
+    u_int64_t pos = cellPos(x, y);
+    PROFILE_COUNT(PROF_PLACE_CELLS, 1);
+    if (cellType(pos) == EMPTY)
+      return pos;
+    if (dx && ++x == WORLD_WIDTH)
+      x = 0;
+    if (dy && ++y == WORLD_HEIGHT)
+      y = 0;
+    --n;
+  }
+  return -1;
+}
+
+// find a place to put the baby: the nearest empty cell around mom, ring by
+// ring out to PLACE_RADIUS, or failing that the first empty cell of the
+// nearest block after hers that has one. Returns 0 when there is no room
+// at all
+static int placeBaby(int baby, u_int64_t mom_pos) {
+  int x0 = cellX(mom_pos), y0 = cellY(mom_pos);
+  int64_t pos = -1;
+  for (int r = 1; r <= PLACE_RADIUS && pos < 0; ++r) {
+    pos = findEmptyOnLine(x0 - r, y0 - r, 1, 0, 2 * r + 1);
+    if (pos < 0)
+      pos = findEmptyOnLine(x0 - r, y0 + r, 1, 0, 2 * r + 1);
+    if (pos < 0)
+      pos = findEmptyOnLine(x0 - r, y0 - r + 1, 0, 1, 2 * r - 1);
+    if (pos < 0)
+      pos = findEmptyOnLine(x0 + r, y0 - r + 1, 0, 1, 2 * r - 1);
+  }
+  int64_t blocks = (int64_t)g_freeBlocksAcross * g_freeBlocksDown;
+  int64_t first = (int64_t)(y0 / FREE_BLOCK_SIZE) * g_freeBlocksAcross +
+                  x0 / FREE_BLOCK_SIZE;
+  for (int64_t k = 0; k < blocks && pos < 0; ++k) {
+    int64_t b = (first + k) % blocks;
+    int bx = b % g_freeBlocksAcross * FREE_BLOCK_SIZE;
+    int by = b / g_freeBlocksAcross * FREE_BLOCK_SIZE;
+    if (*freeCountAt(bx, by) == 0)
+      continue;
+    for (int y = by; y < by + FREE_BLOCK_SIZE && y < WORLD_HEIGHT && pos < 0;
+         ++y)
+      for (int x = bx; x < bx + FREE_BLOCK_SIZE && x < WORLD_WIDTH; ++x)
+        if (cellType(cellPos(x, y)) == EMPTY) {
+          pos = cellPos(x, y);
+          break;
+        }
+  }
+  if (pos < 0) {
+    printf("Error: No space to put baby\n");
+    freeBugSlot(baby);
+    return 0;
+  }
+  g_bugs.x[baby] = cellX(pos);
+  g_bugs.y[baby] = cellY(pos);
+  PROFILE_COUNT(PROF_BABIES_PLACED, 1);
+  return 1;
+}
+
+static void payMatingCost(StepCtx *ctx, int idx) {
+  if (g_bugs.health[idx] <= MATING_COST) {
+    setHealth(ctx, idx, 0);
+  } else
+    setHealth(ctx, idx, g_bugs.health[idx] - MATING_COST);
+}
+
+/// @brief Create a new bug using the DNA of the parents
+void birthABug(StepCtx *ctx, int dad_idx, int mom_idx, u_int64_t mom_pos) {
+  int baby = allocBugSlot();
+
+  if (baby == -1) {
+    printf("Error: Too many bugs\n");
+    return;
+  }
+
+  int mom = mom_idx;
+  int dad = dad_idx;
+  // DNA is a combination of the parents' DNA
+  g_bugs.health[baby] = (g_bugs.health[mom] + g_bugs.health[dad]) / 2;
+  g_bugs.vision[baby] = (g_bugs.vision[mom] + g_bugs.vision[dad]) / 2;
+  g_bugs.speed[baby] = (g_bugs.speed[mom] + g_bugs.speed[dad]) / 2;
+  g_bugs.drive[baby] = (g_bugs.drive[mom] + g_bugs.drive[dad]) / 2;
+  g_bugs.aggr[baby] = (g_bugs.aggr[mom] + g_bugs.aggr[dad]) / 2;
+  RngBlock draw = rngBlock(ctx->frame, dad, RNG_BIRTH);
+  g_bugs.sex[baby] = draw.v[0] % 2;
+  g_bugs.age[baby] = 0;
+  // perform  a mutation
+  if (draw.v[1] % 100 >= MUTATION_RATE * 100) {
+    int bit = draw.v[2] % 32;
+    g_bugs.dna[baby] ^= 1 << bit;
+  }
+
+  int placed = placeBaby(baby, mom_pos);
+  if (placed)
+    countBug(&ctx->stats, baby, 1);
+  calculateDNA(baby);
+  if (placed && g_record.file)
+    recordBirth(&ctx->events, baby, mom, dad);
+  if (placed && g_lineage.file)
+    addLineage(baby, ctx->frame, g_lineage.of[mom], g_lineage.of[dad]);
+
+  payMatingCost(ctx, mom);
+  payMatingCost(ctx, dad);
+  ++ctx->births;
+}
+
+// the tiled step's birthABug: the parents pay now and the baby's genes are
+// fixed now, but the slot and the place in the world wait for the end of
+// the frame (deliverBabies)
+static void conceiveABug(StepCtx *ctx, int dad, int mom, u_int64_t mom_pos) {
+  if (ctx->nbabies == ctx->babyCapacity) {
+    ctx->babyCapacity = ctx->babyCapacity ? ctx->babyCapacity * 2 : 16;
+    ctx->babies = sharedRealloc(ctx->babies, ctx->babyCapacity * sizeof(Baby));
+    if (ctx->babies == NULL) {
+      perror("Error: Unable to allocate memory for babies\n");
+      exit(1);
+    }
+  }
+  Baby *baby = &ctx->babies[ctx->nbabies++];
+  baby->mom_pos = mom_pos;
+  baby->mom = mom;
+  baby->dad = dad;
+  baby->health = (g_bugs.health[mom] + g_bugs.health[dad]) / 2;
+  baby->vision = (g_bugs.vision[mom] + g_bugs.vision[dad]) / 2;
+  baby->speed = (g_bugs.speed[mom] + g_bugs.speed[dad]) / 2;
+  baby->drive = (g_bugs.drive[mom] + g_bugs.drive[dad]) / 2;
+  baby->aggr = (g_bugs.aggr[mom] + g_bugs.aggr[dad]) / 2;
+  RngBlock draw = rngBlock(ctx->frame, dad, RNG_BIRTH);
+  baby->sex = draw.v[0] % 2;
+  baby->mutation_bit = -1;
+  if (draw.v[1] % 100 >= MUTATION_RATE * 100)
+    baby->mutation_bit = draw.v[2] % 32;
+
+  payMatingCost(ctx, mom);
+  payMatingCost(ctx, dad);
+}
+
+// give the babies conceived in a tile their slots and places
+static void deliverBabies(StepCtx *ctx) {
+  for (int k = 0; k < ctx->nbabies; ++k) {
+    Baby *b = &ctx->babies[k];
+    int baby = allocBugSlot();
+    if (baby == -1) {
+      printf("Error: Too many bugs\n");
+      continue;
+    }
+    g_bugs.health[baby] = b->health;
+    g_bugs.vision[baby] = b->vision;
+    g_bugs.speed[baby] = b->speed;
+    g_bugs.drive[baby] = b->drive;
+    g_bugs.aggr[baby] = b->aggr;
+    g_bugs.sex[baby] = b->sex;
+    g_bugs.age[baby] = 0;
+    if (b->mutation_bit >= 0)
+      g_bugs.dna[baby] ^= 1 << b->mutation_bit;
+    int placed = placeBaby(baby, b->mom_pos);
+    if (placed)
+      countBug(&ctx->stats, baby, 1);
+    calculateDNA(baby);
+    if (placed && g_record.file)
+      recordBirth(&g_record.frame, baby, b->mom, b->dad);
+    if (placed && g_lineage.file)
+      addLineage(baby, ctx->frame, b->momLine, b->dadLine);
+    ++ctx->births;
+  }
+  ctx->nbabies = 0;
+}
+
+//-------------------------------------------------------------
+// bugFight - fight to the death
+// ** updated - bug1 always wins - it can see bug2's health before the fight
+// ----------------------------------------------------------
+void bugFight(StepCtx *ctx, int idx1, int idx2) {
+
+  int new_health = (g_bugs.health[idx1] + g_bugs.health[idx2]) - FIGHTING_COST;
+  /*
+  printf("bug2[%d](%d,%d) h:%d age:%d\tbug1[%d](%d,%d) h:%d age:%d\n", idx2,
+         g_bugs.x[idx2], g_bugs.y[idx2], g_bugs.health[idx2],
+         g_bugs.age[idx2], idx1, g_bugs.x[idx1], g_bugs.y[idx1],
+         g_bugs.health[idx1], g_bugs.age[idx1]);
+         */
+
+  setHealth(ctx, idx2, 0);
+  if (new_health > 255)
+    new_health = 255;
+  else if (new_health <= 0)
+    new_health = 0;
+  setHealth(ctx, idx1, new_health);
+  ++ctx->fights;
+  if (g_record.file)
+    recordFight(&ctx->events, idx1, idx2);
+}
+
+// The world is seeded in row bands, one per thread. Every draw is keyed by
+// its cell, so a band doesn't depend on the others, except for the slots
+// of its bugs: those are handed out in row order, as one bug after another
+// would take them, once every band has counted its own.
+typedef struct InitBand {
+  int y0, y1;
+  int first; // slot of the band's first bug
+  int bugs;
+  PopStats stats;
+  pthread_t thread;
+} InitBand;
+
+// pass 1: lay out food and poison, and mark where the bugs go
+static void *seedBand(void *arg) {
+  InitBand *band = arg;
+  for (int y = band->y0; y < band->y1; ++y) {
+    for (int x = 0; x < WORLD_WIDTH; ++x) {
+      u_int64_t pos = cellPos(x, y);
+      if (cellType(pos) == POISON) {
+        continue;
+      }
+      if (cellType(pos) == FOOD) {
+        continue;
+      }
+      // the draws are numbered by the cell's place in row order
+      u_int64_t i = (u_int64_t)y * WORLD_WIDTH + x;
+      RngBlock draw = rngBlock(0, i, RNG_INIT_CELL);
+      if (draw.v[0] % 10000 < INIT_BUG_PROB * 10000) {
+        setCellBug(pos, 0);
+        ++band->bugs;
+      } else if (draw.v[1] % 100 < INIT_FOOD_PROB * 100) {
+        setCellType(pos, FOOD);
+      } else if (draw.v[2] % 10000 < INIT_POISON_PROB * 10000) {
+        setCellType(pos, POISON);
+      }
+    }
+  }
+  return NULL;
+}
+
+// pass 2: give the marked cells their bugs
+static void *populateBand(void *arg) {
+  InitBand *band = arg;
+  int idx = band->first;
+  for (int y = band->y0; y < band->y1; ++y)
+    for (int x = 0; x < WORLD_WIDTH; ++x)
+      if (cellType(cellPos(x, y)) == BUG)
+        immaculateBirthABug((u_int64_t)y * WORLD_WIDTH + x, x, y, idx++,
+                            &band->stats);
+  return NULL;
+}
+
+// run pass on every band, on a thread each
+static void runBands(InitBand *bands, int n, void *(*pass)(void *)) {
+  for (int b = 1; b < n; ++b)
+    pthread_create(&bands[b].thread, NULL, pass, &bands[b]);
+  pass(&bands[0]);
+  for (int b = 1; b < n; ++b)
+    pthread_join(bands[b].thread, NULL);
+}
+
+void initializeWorld(int threads) {
+  printf("Initializing world\n");
+  // create a block of poison
+  for (int x = 250; x < 300 && x < WORLD_WIDTH; ++x) {
+    for (int y = 250; y < 300 && y < WORLD_HEIGHT; ++y) {
+      setCellType(cellPos(x, y), POISON);
+    }
+  }
+  // the frame before the first one
+  for (int i = 0; i < NBR_FOOD_SQUARES; ++i) {
+    addFood(rngBlock(~0ull, i, RNG_FOOD));
+  }
+  int n = threads > 1 ? threads : 1;
+  if (n > WORLD_HEIGHT)
+    n = WORLD_HEIGHT;
+  InitBand *bands = calloc(n, sizeof(InitBand));
+  if (bands == NULL) {
+    perror("Error: Unable to allocate memory for the world's bands");
+    exit(1);
+  }
+  for (int b = 0; b < n; ++b) {
+    bands[b].y0 = (int64_t)b * WORLD_HEIGHT / n;
+    bands[b].y1 = (int64_t)(b + 1) * WORLD_HEIGHT / n;
+  }
+  runBands(bands, n, seedBand);
+  int bugs = 0;
+  for (int b = 0; b < n; ++b) {
+    bands[b].first = bugs;
+    bugs += bands[b].bugs;
+  }
+  // the whole population in one go rather than a slot at a time
+  while (g_bugs.capacity < bugs)
+    growBugPool();
+  markPacked(bugs);
+  g_bugs.live = bugs;
+  runBands(bands, n, populateBand);
+  for (int b = 0; b < n; ++b)
+    foldStats(&bands[b].stats);
+  free(bands);
+  if (g_lineage.file)
+    for (int idx = 0; idx < bugs; ++idx)
+      addLineage(idx, 0, LINEAGE_NONE, LINEAGE_NONE);
+  if (g_verbose) {
+    for (int idx = 0; idx < bugs; ++idx) {
+      printf("Bug %d: x: %d y: %d\n", idx, g_bugs.x[idx], g_bugs.y[idx]);
+      displayBugDNA(idx);
+    }
+  }
+}
+
+// resolve what a bug that just moved to screen_pos landed on
+static void bugLand(StepCtx *ctx, int i, u_int64_t screen_pos) {
+  // moving could mean the death of the bug
+  if (g_bugs.health[i] == 0) {
+    bugDeath(ctx, i, screen_pos);
+    return;
+  }
+  // the bug is in a new position (but not yet stored in the world)
+  // see what they landed on and act accordingly
+  if (cellType(screen_pos) == FOOD) {
+    setHealth(ctx, i,
+              g_bugs.health[i] > 255 - FOOD_HEALTH ? 255
+                                                   : g_bugs.health[i] +
+                                                         FOOD_HEALTH);
+  } else if (cellType(screen_pos) == POISON) {
+    setHealth(ctx, i,
+              g_bugs.health[i] < POISON_COST ? 0
+                                             : g_bugs.health[i] - POISON_COST);
+    if (g_bugs.health[i] == 0) {
+      bugDeath(ctx, i, screen_pos);
+      return;
+    }
+  } else if (cellType(screen_pos) == BUG) {
+    int other = cellBug(screen_pos);
+    if (!bugsAreSameSex(other, i)) {
+      // if bugs are not the same sex and their drive is high enough, and
+      // if they are old enough, and if they have enough health---mate
+      if (g_bugs.drive[i] > moveDraws(ctx, i).v[3] % 16 &&
+          g_bugs.health[i] > MATING_COST &&
+          g_bugs.health[other] > MATING_COST &&
+          g_bugs.age[i] >= MIN_MATING_AGE &&
+          g_bugs.age[other] >= MIN_MATING_AGE) {
+        if (ctx->deferBirths)
+          conceiveABug(ctx, i, other, screen_pos);
+        else
+          birthABug(ctx, i, other, screen_pos);
+      }
+    } else if (g_bugs.aggr[i] > moveDraws(ctx, i).v[3] % 16 &&
+               g_bugs.age[i] >= MIN_FIGHTING_AGE &&
+               g_bugs.health[i] > g_bugs.health[other]) {
+      bugFight(ctx, i, other);
+      if (g_bugs.health[other] == 0) {
+        bugDeath(ctx, other, screen_pos);
+      }
+      if (g_bugs.health[i] == 0) {
+        bugDeath(ctx, i, screen_pos);
+        return;
+      }
+    }
+  }
+  calculateDNA(i);
+  if (bugIsAlive(i)) {
+    setCellBug(screen_pos, i);
+    g_bugs.age[i]++;
+  }
+}
+
+//-------------------------------------------------------------
+// stepBug - move one live bug and resolve what it landed on
+// ----------------------------------------------------------
+void stepBug(StepCtx *ctx, int i) {
+  PROFILE_START(PROF_MOVE);
+  u_int64_t screen_pos = cellPos(g_bugs.x[i], g_bugs.y[i]);
+  u_int64_t old_screen_pos = screen_pos;
+  setCellType(screen_pos, EMPTY);
+  screen_pos = bugMove(ctx, i);
+  if (g_record.file)
+    recordMove(ctx, i, old_screen_pos);
+  PROFILE_SWITCH(PROF_MOVE, PROF_INTERACT);
+  bugLand(ctx, i, screen_pos);
+  if (g_record.file)
+    recordLanded(ctx, i);
+  PROFILE_STOP(PROF_INTERACT);
+  PROFILE_COUNT(PROF_BUG_STEPS, 1);
+}
+
+// claim tiles of the current phase until there are none left
+static void stepTile(int t) {
+  StepCtx *ctx = &g_tiles.ctx[t];
+  ctx->frame = g_tiles.frame;
+  for (int j = g_tiles.first[t]; j < g_tiles.first[t + 1]; ++j) {
+    int i = g_tiles.order[j];
+    if (bugIsAlive(i))
+      stepBug(ctx, i);
+  }
+}
+
+// the strip of tile t's row
+static inline int stripOf(int t) {
+  return (int64_t)(t / g_tiles.nx) * g_tiles.threads / g_tiles.ny;
+}
+
+static void tileWorker(void) {
+  int phase = g_tiles.phase;
+  if (g_tiles.procs) {
+    for (int k = 0; k < g_tiles.phaseCount[phase]; ++k)
+      if (stripOf(g_tiles.phaseTiles[phase][k]) == g_tiles.rank)
+        stepTile(g_tiles.phaseTiles[phase][k]);
+    return;
+  }
+  int k;
+  while ((k = __atomic_fetch_add(&g_tiles.nextTile, 1, __ATOMIC_RELAXED)) <
+         g_tiles.phaseCount[phase])
+    stepTile(g_tiles.phaseTiles[phase][k]);
+}
+
+static void *tileThread(void *arg) {
+  (void)arg;
+  for (;;) {
+    pthread_barrier_wait(g_tiles.start);
+    if (g_tiles.quit)
+      return NULL;
+    tileWorker();
+    pthread_barrier_wait(g_tiles.done);
+  }
+}
+
+// a --procs helper: takes what moved from the StripShare and steps its
+// strip, phase after phase, until told to quit
+static void stripProcess(int rank) {
+  // don't outlive the calling process, which the barriers would wait for
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+  if (getppid() == 1)
+    _exit(1);
+  g_tiles.rank = rank;
+  for (;;) {
+    pthread_barrier_wait(g_tiles.start);
+    StripShare *share = g_tiles.share;
+    if (share->quit)
+      _exit(0);
+    g_bugs = share->bugs;
+    g_moveDraws = share->moveDraws;
+    g_moveDrawCount = share->moveDrawCount;
+    g_tiles.order = share->order;
+    g_tiles.phase = share->phase;
+    g_tiles.frame = share->frame;
+    tileWorker();
+    pthread_barrier_wait(g_tiles.done);
+  }
+}
+
+// split the world into tiles and start threads - 1 helpers, processes if
+// procs is set; the caller is the remaining one. Returns 0 if the world is
+// too small to tile
+int initTiles(int threads, int procs) {
+  g_tiles.nx = WORLD_WIDTH / TILE_TARGET_SIZE & ~1;
+  g_tiles.ny = WORLD_HEIGHT / TILE_TARGET_SIZE & ~1;
+  if (g_tiles.nx < 2)
+    g_tiles.nx = 2;
+  if (g_tiles.ny < 2)
+    g_tiles.ny = 2;
+  if (WORLD_WIDTH / g_tiles.nx < MIN_TILE_SIZE ||
+      WORLD_HEIGHT / g_tiles.ny < MIN_TILE_SIZE)
+    return 0;
+  int ntiles = g_tiles.nx * g_tiles.ny;
+  g_tiles.tileOfX = malloc(WORLD_WIDTH * sizeof(int));
+  g_tiles.tileOfY = malloc(WORLD_HEIGHT * sizeof(int));
+  g_tiles.first = sharedCalloc(ntiles + 1, sizeof(int));
+  g_tiles.ctx = sharedCalloc(ntiles, sizeof(StepCtx));
+  g_tiles.workers = malloc(threads * sizeof(pthread_t));
+  g_tiles.pids = malloc(threads * sizeof(pid_t));
+  g_tiles.start = sharedCalloc(1, sizeof(pthread_barrier_t));
+  g_tiles.done = sharedCalloc(1, sizeof(pthread_barrier_t));
+  g_tiles.share = sharedCalloc(1, sizeof(StripShare));
+  for (int c = 0; c < 4; ++c)
+    g_tiles.phaseTiles[c] = malloc(ntiles * sizeof(int));
+  if (g_tiles.tileOfX == NULL || g_tiles.tileOfY == NULL ||
+      g_tiles.first == NULL || g_tiles.ctx == NULL || g_tiles.workers == NULL ||
+      g_tiles.pids == NULL || g_tiles.start == NULL || g_tiles.done == NULL ||
+      g_tiles.share == NULL || g_tiles.phaseTiles[3] == NULL) {
+    perror("Error: Unable to allocate memory for tiles\n");
+    exit(1);
+  }
+  for (int x = 0; x < WORLD_WIDTH; ++x)
+    g_tiles.tileOfX[x] = (int64_t)x * g_tiles.nx / WORLD_WIDTH;
+  for (int y = 0; y < WORLD_HEIGHT; ++y)
+    g_tiles.tileOfY[y] = (int64_t)y * g_tiles.ny / WORLD_HEIGHT;
+  for (int t = 0; t < ntiles; ++t) {
+    int colour = (t % g_tiles.nx & 1) | (t / g_tiles.nx & 1) << 1;
+    g_tiles.phaseTiles[colour][g_tiles.phaseCount[colour]++] = t;
+    g_tiles.ctx[t].deferBirths = 1;
+  }
+  g_tiles.threads = threads;
+  g_tiles.procs = procs;
+  pthread_barrierattr_t attr;
+  pthread_barrierattr_init(&attr);
+  if (procs)
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init(g_tiles.start, &attr, threads);
+  pthread_barrier_init(g_tiles.done, &attr, threads);
+  pthread_barrierattr_destroy(&attr);
+  fflush(stdout);
+  for (int k = 1; k < threads; ++k) {
+    if (!procs) {
+      pthread_create(&g_tiles.workers[k], NULL, tileThread, NULL);
+      continue;
+    }
+    g_tiles.pids[k] = fork();
+    if (g_tiles.pids[k] < 0) {
+      perror("Error: Unable to start a strip process");
+      exit(1);
+    }
+    if (g_tiles.pids[k] == 0)
+      stripProcess(k);
+  }
+  return 1;
+}
+
+void freeTiles(void) {
+  if (g_tiles.threads == 0)
+    return;
+  g_tiles.quit = 1;
+  g_tiles.share->quit = 1;
+  pthread_barrier_wait(g_tiles.start);
+  for (int k = 1; k < g_tiles.threads; ++k) {
+    if (g_tiles.procs)
+      waitpid(g_tiles.pids[k], NULL, 0);
+    else
+      pthread_join(g_tiles.workers[k], NULL);
+  }
+  pthread_barrier_destroy(g_tiles.start);
+  pthread_barrier_destroy(g_tiles.done);
+  for (int t = 0; t < g_tiles.nx * g_tiles.ny; ++t) {
+    sharedFree(g_tiles.ctx[t].babies);
+    sharedFree(g_tiles.ctx[t].events.data);
+  }
+  for (int c = 0; c < 4; ++c)
+    free(g_tiles.phaseTiles[c]);
+  free(g_tiles.tileOfX);
+  free(g_tiles.tileOfY);
+  sharedFree(g_tiles.first);
+  sharedFree(g_tiles.order);
+  sharedFree(g_tiles.ctx);
+  sharedFree(g_tiles.start);
+  sharedFree(g_tiles.done);
+  sharedFree(g_tiles.share);
+  free(g_tiles.workers);
+  free(g_tiles.pids);
+  g_tiles.threads = 0;
+}
+
+// one frame of the tiled step
+static void stepTiles(u_int64_t frame) {
+  int ntiles = g_tiles.nx * g_tiles.ny;
+  // bucket the live bugs by the tile they start the frame in
+  if (g_tiles.orderCapacity < g_bugs.live) {
+    g_tiles.orderCapacity = g_bugs.capacity;
+    g_tiles.order =
+        sharedRealloc(g_tiles.order, g_tiles.orderCapacity * sizeof(int));
+    if (g_tiles.order == NULL) {
+      perror("Error: Unable to allocate memory for tiles\n");
+      exit(1);
+    }
+  }
+  memset(g_tiles.first, 0, (ntiles + 1) * sizeof(int));
+  FOR_EACH_LIVE_BUG(i) {
+    ++g_tiles.first[g_tiles.tileOfY[g_bugs.y[i]] * g_tiles.nx +
+                    g_tiles.tileOfX[g_bugs.x[i]] + 1];
+  }
+  for (int t = 0; t < ntiles; ++t)
+    g_tiles.first[t + 1] += g_tiles.first[t];
+  FOR_EACH_LIVE_BUG(i) {
+    int t = g_tiles.tileOfY[g_bugs.y[i]] * g_tiles.nx +
+            g_tiles.tileOfX[g_bugs.x[i]];
+    g_tiles.order[g_tiles.first[t]++] = i;
+  }
+  for (int t = ntiles; t > 0; --t)
+    g_tiles.first[t] = g_tiles.first[t - 1];
+  g_tiles.first[0] = 0;
+
+  g_tiles.frame = frame;
+  for (int phase = 0; phase < 4; ++phase) {
+    g_tiles.phase = phase;
+    g_tiles.nextTile = 0;
+    if (g_tiles.procs) {
+      StripShare *share = g_tiles.share;
+      share->phase = phase;
+      share->frame = frame;
+      share->bugs = g_bugs;
+      share->moveDraws = g_moveDraws;
+      share->moveDrawCount = g_moveDrawCount;
+      share->order = g_tiles.order;
+    }
+    pthread_barrier_wait(g_tiles.start);
+    tileWorker();
+    pthread_barrier_wait(g_tiles.done);
+  }
+  if (g_tiles.procs) {
+    // the other strips' deaths freed their slots in shared memory, but
+    // only counted them in their own copy of the pool
+    for (int t = 0; t < ntiles; ++t)
+      if (stripOf(t) != 0)
+        g_bugs.live -= g_tiles.ctx[t].deaths;
+  }
+
+  // the tiles' events in an order they could have happened in one after
+  // another: those of a phase don't touch each other
+  if (g_record.file)
+    for (int phase = 0; phase < 4; ++phase)
+      for (int k = 0; k < g_tiles.phaseCount[phase]; ++k)
+        takeEvents(&g_tiles.ctx[g_tiles.phaseTiles[phase][k]].events);
+
+  // the parents' lineage entries, before a parent that died this frame can
+  // give its slot to a baby
+  if (g_lineage.file)
+    for (int t = 0; t < ntiles; ++t)
+      for (int k = 0; k < g_tiles.ctx[t].nbabies; ++k) {
+        Baby *b = &g_tiles.ctx[t].babies[k];
+        b->momLine = g_lineage.of[b->mom];
+        b->dadLine = g_lineage.of[b->dad];
+      }
+
+  // births in tile order
+  PROFILE_START(PROF_BIRTHS);
+  for (int t = 0; t < ntiles; ++t) {
+    StepCtx *ctx = &g_tiles.ctx[t];
+    deliverBabies(ctx);
+    g_births += ctx->births;
+    g_fights += ctx->fights;
+    g_deaths += ctx->deaths;
+    ctx->births = ctx->fights = ctx->deaths = 0;
+    foldStats(&ctx->stats);
+  }
+  PROFILE_STOP(PROF_BIRTHS);
+}
+
+// regenerate food and poison: every empty cell turns to food with
+// probability pf, or else to poison with probability pp. Instead of a draw
+// per cell, jump from one cell that changes straight to the next over a
+// geometrically distributed gap, so the cost follows the number of cells
+// that change and is nothing at all when both rates are zero.
+static void regenerate(u_int64_t frame) {
+  // the rates as the old per-cell draws resolved them
+  double pf = ceil(REGENERATE_FOOD_RATE * 10000) / 10000;
+  double pp = ceil(REGENERATE_POISON_RATE * 100000) / 100000;
+  double p = pf + (1 - pf) * pp;
+  if (p <= 0)
+    return;
+  double log_miss = p < 1 ? log1p(-p) : 0;
+  u_int64_t cells = (u_int64_t)WORLD_WIDTH * WORLD_HEIGHT;
+  u_int64_t i = 0;
+  int64_t last = -1; // the last cell recorded
+  if (g_record.file)
+    putByte(&g_record.frame, EV_REGENERATE);
+  for (u_int64_t k = 0;; ++k, ++i) {
+    RngBlock draw = rngBlock(frame, k, RNG_REGENERATE);
+    if (p < 1) {
+      double gap = log((draw.v[0] + 1.0) / 4294967296.0) / log_miss;
+      if (gap >= cells - i)
+        break;
+      i += (u_int64_t)gap;
+    }
+    if (i >= cells)
+      break;
+    u_int64_t pos = cellPos(i % WORLD_WIDTH, i / WORLD_WIDTH);
+    if (cellType(pos) != EMPTY)
+      continue;
+    WORLDCELL_TYPE type = draw.v[1] / 4294967296.0 * p < pf ? FOOD : POISON;
+    setCellType(pos, type);
+    if (g_record.file) {
+      putVarint(&g_record.frame, (i - last) << 1 | (type == POISON));
+      last = i;
+    }
+  }
+  if (g_record.file)
+    putVarint(&g_record.frame, 0);
+}
+
+//-------------------------------------------------------------
+// simulateFrame - advance the world by one frame: move every live bug,
+// resolve what it landed on, then regenerate food and poison
+// ----------------------------------------------------------
+void simulateFrame(u_int64_t frame) {
+  if (g_record.file)
+    recordFrameStart(frame);
+  if (g_moveDrawCapacity < g_bugs.count) {
+    g_moveDrawCapacity = g_bugs.capacity;
+    g_moveDraws =
+        sharedRealloc(g_moveDraws, g_moveDrawCapacity * sizeof(RngBlock));
+    if (g_moveDraws == NULL) {
+      perror("Error: Unable to allocate memory for random numbers\n");
+      exit(1);
+    }
+  }
+  PROFILE_START(PROF_DRAWS);
+  rngFill(frame, 0, g_bugs.count, RNG_MOVE, g_moveDraws);
+  g_moveDrawCount = g_bugs.count;
+  PROFILE_STOP(PROF_DRAWS);
+  g_serialStep.frame = frame;
+  PROFILE_START(PROF_STEP);
+  if (g_tiles.threads) {
+    stepTiles(frame);
+  } else {
+    StepCtx *ctx = &g_serialStep;
+    FOR_EACH_LIVE_BUG(i) { stepBug(ctx, i); }
+    if (g_record.file)
+      takeEvents(&ctx->events);
+    g_births += ctx->births;
+    g_fights += ctx->fights;
+    g_deaths += ctx->deaths;
+    ctx->births = ctx->fights = ctx->deaths = 0;
+    foldStats(&ctx->stats);
+  }
+  PROFILE_STOP(PROF_STEP);
+  if (frame % 100 == 0) {
+    printf("Frame: %lu Fights:%d Births:%d Deaths:%d  PopX:%d\n", frame,
+           g_fights, g_births, g_deaths, g_births - g_deaths);
+    g_births = 0;
+    g_fights = 0;
+    g_deaths = 0;
+  }
+  // regenerate food and poison -- old way
+  PROFILE_START(PROF_REGENERATE);
+  regenerate(frame);
+  PROFILE_STOP(PROF_REGENERATE);
+  // food regeneration - new way
+  if (frame % FRAMES_TILL_FOOD == 0) {
+    PROFILE_START(PROF_ADD_FOOD);
+    addFood(rngBlock(frame, 0, RNG_FOOD));
+    PROFILE_STOP(PROF_ADD_FOOD);
+  }
+  if (g_compactEvery && frame % g_compactEvery == 0) {
+    PROFILE_START(PROF_COMPACT);
+    if (g_compactMorton)
+      sortBugs();
+    else
+      compactBugs();
+    if (g_record.file)
+      putByte(&g_record.frame, g_compactMorton ? EV_SORT : EV_COMPACT);
+    PROFILE_STOP(PROF_COMPACT);
+  }
+#ifdef CHUNKED_WORLD
+  if (frame % CHUNK_TRIM_EVERY == 0)
+    trimChunks();
+#endif
+  if (g_record.file)
+    recordFrameEnd(frame);
+}
+
+// A checkpoint is everything a run carries from one frame to the next: the
+// world, every pool slot (free slots too, as reused slots start from what
+// the last bug in them left behind), the frame counters, the seed and the
+// knobs. The file is a header followed by one section per array, each padded
+// to CHECKPOINT_ALIGN, in native byte order. Restoring maps the file and
+// copies the sections straight into place.
+//
+// The world (section 0) is stored one of two ways. The dense build writes
+// every cell, in row order. The chunked build writes a directory of the
+// chunks in use, each entry the chunk's index and the file offset of its
+// cells, followed by those chunks' cells, so the file grows with the
+// occupied area rather than the size of the world. Either build restores
+// either layout.
+#define CHECKPOINT_MAGIC "BUGSNAP"
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_ALIGN 64
+#define CHECKPOINT_SECTIONS 12
+
+typedef struct CheckpointHeader {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t width, height;
+  u_int32_t capacity, count, live;
+  u_int32_t births, fights, deaths;
+  u_int64_t frame; // the next frame to simulate
+  u_int64_t seed;
+  u_int64_t chunks;    // in the directory; unused when the world is dense
+  u_int32_t chunkSize; // along a side; 0 when the world is dense
+  Params params;
+} CheckpointHeader;
+
+typedef struct CheckpointChunk {
+  u_int64_t index;  // in the world's chunk directory, row by row
+  u_int64_t offset; // of its cells, from the start of the file
+} CheckpointChunk;
+
+typedef struct CheckpointSection {
+  void *data;
+  size_t size;
+} CheckpointSection;
+
+static size_t checkpointAlign(size_t size) {
+  return (size + CHECKPOINT_ALIGN - 1) & ~(size_t)(CHECKPOINT_ALIGN - 1);
+}
+
+// the size of the world's section: every cell, or the chunk directory, then
+// the cells of the chunks in it
+static size_t worldSectionSize(const CheckpointHeader *header) {
+  if (header->chunkSize == 0)
+    return sizeof(u_int32_t) * header->width * header->height;
+  return checkpointAlign(header->chunks * sizeof(CheckpointChunk)) +
+         header->chunks * sizeof(u_int32_t) * header->chunkSize *
+             header->chunkSize;
+}
+
+// the arrays of a checkpoint, in file order, for the current pool capacity.
+// The world (always section 0) has no array to copy from: see writeWorld
+// and readWorld
+static void checkpointSections(CheckpointSection *sections,
+                               const CheckpointHeader *header) {
+  int n = 0;
+  sections[n++] = (CheckpointSection){NULL, worldSectionSize(header)};
+#define SECTION(field)                                                         \
+  sections[n++] = (CheckpointSection){                                         \
+      g_bugs.field, g_bugs.capacity * sizeof(*g_bugs.field)}
+  SECTION(x);
+  SECTION(y);
+  SECTION(age);
+  SECTION(health);
+  SECTION(sex);
+  SECTION(vision);
+  SECTION(speed);
+  SECTION(drive);
+  SECTION(aggr);
+  SECTION(dna);
+#undef SECTION
+  sections[n++] = (CheckpointSection){g_bugs.free[0], g_bugs.capacity / 8};
+  assert(n == CHECKPOINT_SECTIONS);
+}
+
+#ifdef CHUNKED_WORLD
+// how many chunks the world has in use, for the checkpoint's directory
+static u_int64_t chunksInUse(void) {
+  u_int64_t n = 0;
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown; ++c)
+    n += g_chunks[c] != &g_emptyChunk;
+  return n;
+}
+
+// write the directory of the chunks in use, the world section starting at
+// offset, then their cells in the same order
+static int writeWorld(FILE *fp, u_int64_t chunks, size_t offset) {
+  static const char pad[CHECKPOINT_ALIGN];
+  size_t directory = chunks * sizeof(CheckpointChunk);
+  size_t cells = offset + checkpointAlign(directory);
+  int ok = 1;
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown && ok; ++c) {
+    if (g_chunks[c] == &g_emptyChunk)
+      continue;
+    CheckpointChunk entry = {c, cells};
+    ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+    cells += sizeof(g_chunks[c]->cell);
+  }
+  ok &= fwrite(pad, 1, checkpointAlign(directory) - directory, fp) ==
+        checkpointAlign(directory) - directory;
+  for (int64_t c = 0; c < (int64_t)g_chunksAcross * g_chunksDown && ok; ++c)
+    if (g_chunks[c] != &g_emptyChunk)
+      ok = fwrite(g_chunks[c]->cell, sizeof(g_chunks[c]->cell), 1, fp) == 1;
+  return ok;
+}
+#else
+static int writeWorld(FILE *fp, u_int64_t chunks, size_t offset) {
+  (void)chunks;
+  (void)offset;
+  size_t n = (size_t)WORLD_WIDTH * WORLD_HEIGHT;
+  return fwrite(g_worldCell, sizeof(u_int32_t), n, fp) == n;
+}
+#endif
+
+// copy one row of n cells from a checkpoint into the world at (x, y). In the
+// chunked build it goes a chunk's width at a time, and only the stretches
+// with something in them take a chunk
+static void readWorldRow(int x, int y, const u_int32_t *row, int n) {
+#ifdef CHUNKED_WORLD
+  while (n > 0) {
+    int m = CHUNK_SIZE - (x & (CHUNK_SIZE - 1));
+    m = m < n ? m : n;
+    int k = 0;
+    while (k < m && row[k] == EMPTY)
+      ++k;
+    if (k < m) {
+      u_int64_t pos = cellPos(x, y);
+      memcpy(&writableChunk(pos)->cell[pos & ((1u << CHUNK_CELL_BITS) - 1)],
+             row, m * sizeof(u_int32_t));
+    }
+    x += m;
+    row += m;
+    n -= m;
+  }
+#else
+  memcpy(&g_worldCell[cellPos(x, y)], row, n * sizeof(u_int32_t));
+#endif
+}
+
+// load the world section at offset, in whichever layout it was saved.
+// Returns 0 if the chunk directory points outside the world or the file
+static int readWorld(const char *map, size_t size, size_t offset,
+                     const CheckpointHeader *header) {
+  if (header->chunkSize == 0) {
+    const u_int32_t *cells = (const u_int32_t *)(map + offset);
+    for (int y = 0; y < WORLD_HEIGHT; ++y)
+      readWorldRow(0, y, cells + (u_int64_t)y * WORLD_WIDTH, WORLD_WIDTH);
+    return 1;
+  }
+  u_int64_t side = header->chunkSize;
+  u_int64_t across = (WORLD_WIDTH + side - 1) / side;
+  u_int64_t down = (WORLD_HEIGHT + side - 1) / side;
+  size_t bytes = sizeof(u_int32_t) * side * side;
+  const CheckpointChunk *directory = (const CheckpointChunk *)(map + offset);
+  for (u_int64_t k = 0; k < header->chunks; ++k) {
+    CheckpointChunk entry = directory[k];
+    if (entry.index >= across * down || entry.offset > size ||
+        size - entry.offset < bytes || entry.offset % sizeof(u_int32_t) != 0)
+      return 0;
+    const u_int32_t *cells = (const u_int32_t *)(map + entry.offset);
+    int x0 = entry.index % across * side, y0 = entry.index / across * side;
+#ifdef CHUNKED_WORLD
+    // the same chunks as this build's: take the cells whole
+    if (side == CHUNK_SIZE) {
+      memcpy(writableChunk(cellPos(x0, y0))->cell, cells, bytes);
+      continue;
+    }
+#endif
+    int n = WORLD_WIDTH - x0 < (int)side ? WORLD_WIDTH - x0 : (int)side;
+    for (int r = 0; r < (int)side && y0 + r < WORLD_HEIGHT; ++r)
+      readWorldRow(x0, y0 + r, cells + r * side, n);
+  }
+  return 1;
+}
+
+// write the state between frames to name, by way of a temporary file so a
+// crash never leaves a half written checkpoint behind
+void saveCheckpoint(const char *name, u_int64_t frame) {
+  static const char pad[CHECKPOINT_ALIGN];
+  char *tmp_name = malloc(strlen(name) + 5);
+  if (tmp_name == NULL) {
+    perror("Error: Unable to allocate memory for the checkpoint\n");
+    exit(1);
+  }
+  sprintf(tmp_name, "%s.tmp", name);
+  FILE *fp = fopen(tmp_name, "wb");
+  if (fp == NULL) {
+    perror("Error: Unable to write checkpoint");
+    exit(1);
+  }
+  CheckpointHeader header = {.magic = CHECKPOINT_MAGIC,
+                             .version = CHECKPOINT_VERSION,
+                             .width = WORLD_WIDTH,
+                             .height = WORLD_HEIGHT,
+                             .capacity = g_bugs.capacity,
+                             .count = g_bugs.count,
+                             .live = g_bugs.live,
+                             .births = g_births,
+                             .fights = g_fights,
+                             .deaths = g_deaths,
+                             .frame = frame,
+                             .seed = g_seed,
+#ifdef CHUNKED_WORLD
+                             .chunks = chunksInUse(),
+                             .chunkSize = CHUNK_SIZE,
+#endif
+                             .params = g_params};
+  CheckpointSection sections[CHECKPOINT_SECTIONS];
+  checkpointSections(sections, &header);
+  int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  size_t padding = checkpointAlign(sizeof(header)) - sizeof(header);
+  ok &= fwrite(pad, 1, padding, fp) == padding;
+  for (int k = 0; k < CHECKPOINT_SECTIONS; ++k) {
+    padding = checkpointAlign(sections[k].size) - sections[k].size;
+    if (k == 0)
+      ok &= writeWorld(fp, header.chunks, checkpointAlign(sizeof(header)));
+    else
+      ok &= fwrite(sections[k].data, 1, sections[k].size, fp) ==
+            sections[k].size;
+    ok &= fwrite(pad, 1, padding, fp) == padding;
+  }
+  if (fclose(fp) != 0 || !ok || rename(tmp_name, name) != 0) {
+    perror("Error: Unable to write checkpoint");
+    exit(1);
+  }
+  free(tmp_name);
+}
+
+// a checkpoint being restored: its header is read, and the run takes its
+// knobs and world size, before the world is made (openCheckpoint); the
+// rest is loaded into the world after (restoreCheckpoint)
+typedef struct Restore {
+  const char *name;
+  char *map;
+  size_t size;
+  CheckpointHeader header;
+} Restore;
+Restore g_restore;
 
-#define INIT_BUG_PROB 0.0414
-#define INIT_FOOD_PROB 0.0
-#define INIT_POISON_PROB 0.0000
-
-#define REGENERATE_FOOD_RATE 0.0000
-#define REGENERATE_POISON_RATE 0.000000
-#define FRAMES_TILL_FOOD 2
-#define FOOD_SIZE_X 50
-#define FOOD_SIZE_Y 50
-#define NBR_FOOD_SQUARES 400
-#define MUTATION_RATE 0.30
-
-#define FOOD_HEALTH 10
-#define MOVE_COST_PROB 1.0
-#define POISON_COST 250
-#define MOVE_COST 1
-#define MATING_COST 40
-#define FIGHTING_COST 40
-#define MIN_MATING_AGE 1
-#define MIN_FIGHTING_AGE 1
-int PAUSE = 0;
+void openCheckpoint(const char *name) {
+  int fd = open(name, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror("Error: Unable to open checkpoint");
+    exit(1);
+  }
+  if ((size_t)st.st_size < sizeof(CheckpointHeader)) {
+    printf("Error: %s is not a checkpoint\n", name);
+    exit(1);
+  }
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("Error: Unable to map checkpoint");
+    exit(1);
+  }
+  CheckpointHeader header;
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+    printf("Error: %s is not a checkpoint\n", name);
+    exit(1);
+  }
+  if (header.version != CHECKPOINT_VERSION) {
+    printf("Error: checkpoint version %u, expected %u\n", header.version,
+           CHECKPOINT_VERSION);
+    exit(1);
+  }
+  // the run goes on with the knobs it was saved with; --set may repeat one
+  // but not change it. checkParams then holds a build with a fixed world
+  // size to it
+  for (int k = 0; k < NBR_PARAMS; ++k) {
+    size_t offset = PARAM_NAMES[k].offset;
+    if ((g_paramsGiven >> k & 1) &&
+        memcmp((char *)&g_params + offset, (char *)&header.params + offset,
+               PARAM_NAMES[k].isInt ? sizeof(int) : sizeof(double)) != 0) {
+      printf("Error: checkpoint %s was saved with a different %s\n", name,
+             PARAM_NAMES[k].name);
+      exit(1);
+    }
+  }
+  g_params = header.params;
+  g_restore = (Restore){
+      .name = name, .map = map, .size = st.st_size, .header = header};
+}
 
-Color FOOD_COLOR = {0, 255, 0, 255};
-#define FOOD_OPACITY 50
+// load the opened checkpoint into the (still empty) world and pool. The
+// seed is taken from the checkpoint unless keep_seed is set, so one saved
+// world can be forked into runs with different seeds. Returns the next
+// frame
+u_int64_t restoreCheckpoint(int keep_seed) {
+  const char *name = g_restore.name;
+  char *map = g_restore.map;
+  CheckpointHeader header = g_restore.header;
+  while (g_bugs.capacity < (int)header.capacity)
+    growBugPool();
+  CheckpointSection sections[CHECKPOINT_SECTIONS];
+  checkpointSections(sections, &header);
+  size_t offset = checkpointAlign(sizeof(header));
+  for (int k = 0; k < CHECKPOINT_SECTIONS; ++k)
+    offset += checkpointAlign(sections[k].size);
+  int ok = g_bugs.capacity == (int)header.capacity &&
+           offset == g_restore.size &&
+           header.width == (u_int32_t)WORLD_WIDTH &&
+           header.height == (u_int32_t)WORLD_HEIGHT;
+  offset = checkpointAlign(sizeof(header));
+  for (int k = 0; k < CHECKPOINT_SECTIONS && ok; ++k) {
+    if (k == 0)
+      ok = readWorld(map, g_restore.size, offset, &header);
+    else
+      memcpy(sections[k].data, map + offset, sections[k].size);
+    offset += checkpointAlign(sections[k].size);
+  }
+  if (!ok) {
+    printf("Error: checkpoint %s is damaged\n", name);
+    exit(1);
+  }
+  munmap(map, g_restore.size);
+  g_restore.map = NULL;
 
-typedef struct Bug {
-  int x, y;             // Position
-  int isAlive;          // 0|1
-  int age;              // how many frames they've been alive for
-  unsigned char health; // 0 - 255
-  unsigned char sex;    // 0|1
-  unsigned char vision; // 0-15 distance the bug can see
-  unsigned char speed;  // 0 - 3 - how many squares the bug can move
-  unsigned char drive;  // 0 - 15 - how much the bug wnats to mate
-  unsigned char aggr;   // 0 - 15 - how much the bug wants to fight
-  uint32_t dna;         // this doubles for the bug's color
-} Bug;
+  g_bugs.count = header.count;
+  g_bugs.live = header.live;
+  rebuildFreeSummary();
+  g_births = header.births;
+  g_fights = header.fights;
+  g_deaths = header.deaths;
+  if (!keep_seed)
+    g_seed = header.seed;
+  memset(&g_stats, 0, sizeof(g_stats));
+  memset(g_census, 0, CENSUS_GENOTYPES * sizeof(int32_t));
+  FOR_EACH_LIVE_BUG(i) { countBug(&g_stats, i, 1); }
+  return header.frame;
+}
 
-typedef enum { EMPTY = 0, FOOD = 1, POISON = 2, BUG = 3 } WORLDCELL_TYPE;
+// Playing a recording back (--replay) makes the same cell writes the
+// simulation made, from its events. The bugs get their places and colours
+// but none of their traits, so there are no statistics, and a replayed
+// world can't be simulated on from.
+typedef struct Replay {
+  const char *name;
+  const unsigned char *map;
+  size_t mapSize, size; // size: where the records stop
+  size_t at;            // the next record
+  u_int64_t *index; // frame, offset of each keyframe
+  u_int64_t keyframes;
+  u_int64_t end; // one past the last frame
+} Replay;
+Replay g_replay;
 
-struct WorldCell {
-  WORLDCELL_TYPE type[WORLD_WIDTH * WORLD_HEIGHT];
-  Color color[WORLD_WIDTH * WORLD_HEIGHT];
-  int bug_idx[WORLD_WIDTH * WORLD_HEIGHT];
-} *g_worldCell;
+typedef struct Cursor {
+  const unsigned char *at, *end;
+  int bad;
+} Cursor;
 
-u_int64_t g_numBugs = 0;
-u_int32_t g_births = 0, g_fights = 0;
-u_int32_t g_deaths = 0;
+static unsigned char getByte(Cursor *c) {
+  if (c->at == c->end) {
+    c->bad = 1;
+    return 0;
+  }
+  return *c->at++;
+}
 
-gsl_rng *g_rng;
-
-void bugDeath(Bug *bugs, int idx, u_int64_t screen_pos);
-void displayBugDNA(Bug *bug);
-Bug *immaculateBirthABug(int i, Bug *bugs);
-void calculateDNA(Bug *bug);
-void updateStatusLine(Bug *bugs, u_int64_t frame, FILE *ofp);
-u_int64_t bugMove(Bug *bug);
-int bugsAreSameSex(Bug *bug1, Bug *bug2);
-void getMovementProbabilities(Bug *bug, int *left_prob, int *up_prob);
-void addFood(void);
-// int birthABug(Bug *bug, u_int64_t screen_pos);
+static u_int64_t getVarint(Cursor *c) {
+  u_int64_t value = 0;
+  for (int shift = 0; shift < 64 && c->at < c->end; shift += 7) {
+    unsigned char byte = *c->at++;
+    value |= (u_int64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return value;
+  }
+  c->bad = 1;
+  return 0;
+}
 
-void displayBugDNA(Bug *bug) {
-  int i;
+static int64_t getSigned(Cursor *c) {
+  u_int64_t zigzag = getVarint(c);
+  return zigzag >> 1 ^ -(zigzag & 1);
+}
 
-  for (i = 31; i >= 0; i--) {
-    printf("%u", (bug->dna >> i) & 1);
-    if (i % 8 == 0)
-      printf(" ");
-  }
-  printf("\nHealth: (%u) -> %u\n", bug->health, bug->dna & 0xff);
-  printf("Sex: (%u) %u\n", bug->sex, bug->dna >> 31 & 0x01);
-  printf("Vision:(%u) %u\n", bug->vision, bug->dna >> 27 & 0x0f);
-  printf("Speed:(%u) %u\n", bug->speed, bug->dna >> 25 & 0x03);
-  printf("Drive:(%u) %u\n", bug->drive, bug->dna >> 21 & 0x0f);
-  printf("Aggr:(%u) %u\n", bug->aggr, bug->dna >> 17 & 0x0f);
+static void badRecording(void) {
+  printf("Error: %s is truncated or corrupt\n", g_replay.name);
+  exit(1);
 }
 
-Bug *immaculateBirthABug(int i, Bug *bugs) {
-  bugs = realloc(bugs, (g_numBugs + 1) * sizeof(Bug));
-  if (bugs == NULL) {
-    perror("Error: Unable to allocate memory for bugs\n");
-    exit(1);
+// the record at offset at: its kind, frame and bytes. Returns the offset
+// of the next one, or 0 if the record is cut short
+static size_t readRecord(size_t at, int *kind, u_int64_t *frame,
+                         Cursor *body) {
+  Cursor c = {g_replay.map + at, g_replay.map + g_replay.size, 0};
+  *kind = getByte(&c);
+  *frame = getVarint(&c);
+  u_int64_t size = getVarint(&c);
+  if (c.bad || size > (u_int64_t)(c.end - c.at))
+    return 0;
+  *body = (Cursor){c.at, c.at + size, 0};
+  return body->end - g_replay.map;
+}
+
+static void loadKeyframe(Cursor *c) {
+  int count = getVarint(c);
+  int live = getVarint(c);
+  if (c->bad || live > count)
+    badRecording();
+  while (g_bugs.capacity < count)
+    growBugPool();
+  memset(g_bugs.free[0], 0xff, g_bugs.capacity / 8);
+  int slot = -1;
+  for (int n = 0; n < live; ++n) {
+    slot += getVarint(c);
+    if (c->bad || slot >= count)
+      badRecording();
+    g_bugs.free[0][slot >> 6] &= ~(1ull << (slot & 63));
+    g_bugs.x[slot] = getVarint(c);
+    g_bugs.y[slot] = getVarint(c);
+    g_bugs.dna[slot] = getVarint(c);
   }
-  bugs[g_numBugs].x = i % WORLD_WIDTH;
-  bugs[g_numBugs].y = i / WORLD_WIDTH;
-  printf("Bug %lu: x: %d y: %d\n", g_numBugs, bugs[g_numBugs].x,
-         bugs[g_numBugs].y);
-  bugs[g_numBugs].isAlive = 1;
-  bugs[g_numBugs].age = 0;
-  bugs[g_numBugs].sex = gsl_rng_get(g_rng) % 2;
-  bugs[g_numBugs].health = 255;
-  bugs[g_numBugs].vision = gsl_rng_get(g_rng) % 16;
-  bugs[g_numBugs].speed = gsl_rng_get(g_rng) % 4;
-  bugs[g_numBugs].drive = gsl_rng_get(g_rng) % 16;
-  bugs[g_numBugs].aggr = gsl_rng_get(g_rng) % 16;
-  calculateDNA(&bugs[g_numBugs]);
-  displayBugDNA(&bugs[g_numBugs]);
-  g_worldCell->color[i].r = bugs[g_numBugs].dna >> 24 & 0xff;
-  g_worldCell->color[i].g = bugs[g_numBugs].dna >> 16 & 0xff;
-  g_worldCell->color[i].b = bugs[g_numBugs].dna >> 8 & 0xff;
-  // health of the bug is also the alpha channel
-  g_worldCell->color[i].a = bugs[g_numBugs].dna & 0xff;
-  g_worldCell->type[i] = BUG;
-  g_worldCell->bug_idx[i] = g_numBugs;
-  ++g_numBugs;
-  return bugs;
-}
-
-void calculateDNA(Bug *bug) {
-  u_int16_t unused = 0xff;
-  bug->dna = 0;
-  bug->dna |= bug->sex << 31;
-  bug->dna |= bug->vision << 27;
-  bug->dna |= bug->speed << 25;
-  bug->dna |= bug->drive << 21;
-  bug->dna |= bug->aggr << 17;
-  bug->dna |= unused << 9;
-  bug->dna |= bug->health;
-}
-void updateStatusLine(Bug *bugs, u_int64_t frame, FILE *ofp) {
-  char status_line[100];
-  float alive = 0;
-  float health = 0;
-  float drive = 0;
-  float aggr = 0;
-  float vision = 0;
-  float speed = 0;
-
-  for (int i = 0; i < g_numBugs; ++i) {
-    if (bugs[i].isAlive) {
-      ++alive;
-      health += bugs[i].health;
-      drive += bugs[i].drive;
-      aggr += bugs[i].aggr;
-      vision += bugs[i].vision;
-      speed += bugs[i].speed;
-    }
-  }
-  sprintf(status_line, "BUGS: %.0f\tFrame: %8lu", alive, frame);
-  DrawText(status_line, 10, SCREEN_HEIGHT - 23, 20, WHITE);
-  if (ofp)
-    fprintf(ofp, "%.0f\t%lu\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\n", alive, frame,
-            (float)(health / alive), drive / alive, aggr / alive,
-            vision / alive, speed / alive);
+  g_bugs.count = count;
+  g_bugs.live = live;
+  rebuildFreeSummary();
+  clearWorld();
+  u_int64_t cells = (u_int64_t)WORLD_WIDTH * WORLD_HEIGHT;
+  for (u_int64_t cell = 0; cell < cells;) {
+    u_int32_t word = getVarint(c);
+    u_int64_t run = getVarint(c);
+    if (c->bad || run == 0 || run > cells - cell)
+      badRecording();
+    if (word != EMPTY)
+      for (u_int64_t k = cell; k < cell + run; ++k)
+        setCell(cellPos(k % WORLD_WIDTH, k / WORLD_WIDTH),
+                word & CELL_TYPE_MASK, word >> CELL_TYPE_BITS);
+    cell += run;
+  }
+  buildFreeBlocks();
 }
 
-u_int64_t bugMove(Bug *bug) {
-  // look around based on vision
-  // the resources left, right, up and down from the bug will determine the
-  // probability of moving in that direction
-  //
-  // Move bugs randomly if they have 0 vision
-  if (bug->vision == 0) {
-    bug->x += (gsl_rng_get(g_rng) % 3) - 1;
-    bug->y += (gsl_rng_get(g_rng) % 3) - 1;
-  } else {
-    // if the bug has 1  or greater vision it can see the resources around it
-    int left_prob = 0, up_prob = 0;
-    getMovementProbabilities(bug, &left_prob, &up_prob);
-    int x_dir = 0;
-    if (gsl_rng_get(g_rng) % 100 < left_prob) {
-      x_dir = -1 * bug->speed;
-    } else {
-      x_dir = bug->speed;
+// put the bug that last moved down where it landed, unless it died
+static void replayLand(int moved) {
+  if (moved >= 0 && bugIsAlive(moved))
+    setCellBug(cellPos(g_bugs.x[moved], g_bugs.y[moved]), moved);
+}
+
+static void replayEvents(Cursor *c) {
+  int slot = 0, moved = -1;
+  while (c->at < c->end) {
+    int ev = getByte(c);
+    if (ev < EV_TILE) {
+      replayLand(moved);
+      slot += getSigned(c);
+      if (slot < 0 || slot >= g_bugs.count)
+        badRecording();
+      setCellType(cellPos(g_bugs.x[slot], g_bugs.y[slot]), EMPTY);
+      g_bugs.x[slot] = wrapCoord(g_bugs.x[slot] + ev / 7 - 3, WORLD_WIDTH);
+      g_bugs.y[slot] = wrapCoord(g_bugs.y[slot] + ev % 7 - 3, WORLD_HEIGHT);
+      g_bugs.dna[slot] = (g_bugs.dna[slot] & ~0xffu) | getByte(c);
+      moved = slot;
+      continue;
     }
-    int y_dir = 0;
-    if (gsl_rng_get(g_rng) % 100 < up_prob) {
-      y_dir = -1 * bug->speed;
-    } else {
-      y_dir = bug->speed;
+    if (ev != EV_DEATH && ev != EV_FIGHT && ev != EV_BIRTH) {
+      // the rest happen between the bugs' steps
+      replayLand(moved);
+      moved = -1;
+    }
+    switch (ev) {
+    case EV_TILE:
+      slot = 0;
+      break;
+    case EV_DEATH: {
+      int idx = getVarint(c);
+      if (idx >= g_bugs.count || !bugIsAlive(idx))
+        badRecording();
+      setCellType(cellPos(g_bugs.x[idx], g_bugs.y[idx]), EMPTY);
+      freeBugSlot(idx);
+      break;
+    }
+    case EV_FIGHT:
+      getVarint(c);
+      getVarint(c);
+      break;
+    case EV_BIRTH: {
+      int baby = getVarint(c);
+      getVarint(c); // the parents
+      getVarint(c);
+      int x = getVarint(c), y = getVarint(c);
+      u_int32_t dna = getVarint(c);
+      if (c->bad || x >= WORLD_WIDTH || y >= WORLD_HEIGHT ||
+          allocBugSlot() != baby)
+        badRecording();
+      g_bugs.x[baby] = x;
+      g_bugs.y[baby] = y;
+      g_bugs.dna[baby] = dna;
+      break;
+    }
+    case EV_FOOD: {
+      int x = getVarint(c), y = getVarint(c);
+      int width = getVarint(c), height = getVarint(c);
+      putFood(x, y, width, height);
+      break;
+    }
+    case EV_REGENERATE: {
+      u_int64_t cells = (u_int64_t)WORLD_WIDTH * WORLD_HEIGHT;
+      int64_t i = -1;
+      for (u_int64_t step; (step = getVarint(c)) != 0 && !c->bad;) {
+        i += step >> 1;
+        if ((u_int64_t)i >= cells)
+          badRecording();
+        setCellType(cellPos(i % WORLD_WIDTH, i / WORLD_WIDTH),
+                    step & 1 ? POISON : FOOD);
+      }
+      break;
+    }
+    case EV_COMPACT:
+      compactBugs();
+      break;
+    case EV_SORT:
+      sortBugs();
+      break;
+    default:
+      badRecording();
     }
-    bug->x += x_dir;
-    bug->y += y_dir;
+    if (c->bad)
+      badRecording();
   }
+  replayLand(moved);
+}
 
-  // Wrap around screen
-  if (bug->x < 0)
-    bug->x = WORLD_WIDTH - 1;
-  if (bug->x >= WORLD_WIDTH)
-    bug->x = 0;
-  if (bug->y < 0)
-    bug->y = WORLD_HEIGHT - 1;
-  if (bug->y >= WORLD_HEIGHT)
-    bug->y = 0;
-
-  if (gsl_rng_get(g_rng) % 100 < MOVE_COST_PROB * 100) {
-    if (bug->health <= MOVE_COST) {
-      bug->health = 0;
-    } else
-      bug->health -= MOVE_COST;
-  }
-  u_int64_t screen_pos = bug->y * WORLD_WIDTH + bug->x;
-  assert(screen_pos < WORLD_WIDTH * WORLD_HEIGHT);
-  assert(screen_pos >= 0);
-  return screen_pos;
+// play frame back; returns 0 past the end of the recording
+int replayFrame(u_int64_t frame) {
+  int kind;
+  u_int64_t at;
+  Cursor body;
+  do {
+    if (g_replay.at == g_replay.size || frame >= g_replay.end)
+      return 0;
+    g_replay.at = readRecord(g_replay.at, &kind, &at, &body);
+    if (g_replay.at == 0)
+      badRecording();
+  } while (kind == RECORD_KEYFRAME); // the world as it already is
+  if (kind != RECORD_FRAME || at != frame)
+    badRecording();
+  replayEvents(&body);
+  g_stats.alive = g_bugs.live;
+  return 1;
 }
 
-// sum up the resources to the left, right, up and down from the bug
-// by summing up values of each resource type
-//
-void getMovementProbabilities(Bug *bug, int *left_prob, int *up_prob) {
-  int screenx = 0, screeny = 0;
-  double left = 0, right = 0, up = 0, down = 0;
+// go to the world before frame (or the nearest the recording has) by way
+// of the keyframe before it. Returns the frame it went to
+u_int64_t replaySeek(u_int64_t frame) {
+  u_int64_t k = 0;
+  while (k + 1 < g_replay.keyframes && g_replay.index[2 * (k + 1)] <= frame)
+    ++k;
+  int kind;
+  u_int64_t at;
+  Cursor body;
+  g_replay.at = readRecord(g_replay.index[2 * k + 1], &kind, &at, &body);
+  if (g_replay.at == 0 || kind != RECORD_KEYFRAME ||
+      at != g_replay.index[2 * k])
+    badRecording();
+  loadKeyframe(&body);
+  if (body.bad)
+    badRecording();
+  while (at < frame && replayFrame(at))
+    ++at;
+  return at;
+}
 
-  for (int startx = bug->x - bug->vision; startx <= bug->x + bug->vision;
-       ++startx) {
-    for (int starty = bug->y - bug->vision; starty <= bug->y + bug->vision;
-         ++starty) {
-      screenx = startx;
-      screeny = starty;
-
-      // Wrap-around calculations:
-      if (screenx < 0)
-        screenx = WORLD_WIDTH - (-screenx);
-      if (screenx >= WORLD_WIDTH)
-        screenx = screenx - WORLD_WIDTH;
-      if (screeny < 0)
-        screeny = WORLD_HEIGHT - (-screeny);
-      if (screeny >= WORLD_HEIGHT)
-        screeny = screeny - WORLD_HEIGHT;
-
-      int screen_pos = screeny * WORLD_WIDTH + screenx;
-
-      // Horizontal contributions
-      if (startx < bug->x) {
-        if (g_worldCell->type[screen_pos] == FOOD) {
-          left += FOOD_HEALTH;
-        } else if (g_worldCell->type[screen_pos] == POISON) {
-          left -= POISON_COST;
-        } else if (g_worldCell->type[screen_pos] == BUG) {
-          left += bug->aggr + bug->drive;
-        }
-      } else if (startx > bug->x) {
-        if (g_worldCell->type[screen_pos] == FOOD) {
-          right += FOOD_HEALTH;
-        } else if (g_worldCell->type[screen_pos] == POISON) {
-          right -= POISON_COST;
-        } else if (g_worldCell->type[screen_pos] == BUG) {
-          right += bug->aggr + bug->drive;
-        }
-      }
+// map a recording and find its keyframes, reading it through if the run
+// that made it didn't get to write the index. Sets the world's size
+void openReplay(const char *name) {
+  g_replay.name = name;
+  int fd = open(name, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror("Error: Unable to open recording");
+    exit(1);
+  }
+  RecordHeader header;
+  if ((size_t)st.st_size < sizeof(header)) {
+    printf("Error: %s is not a recording\n", name);
+    exit(1);
+  }
+  g_replay.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (g_replay.map == MAP_FAILED) {
+    perror("Error: Unable to map recording");
+    exit(1);
+  }
+  g_replay.mapSize = g_replay.size = st.st_size;
+  memcpy(&header, g_replay.map, sizeof(header));
+  if (memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RECORD_VERSION) {
+    printf("Error: %s is not a recording\n", name);
+    exit(1);
+  }
+  g_params.worldWidth = header.width;
+  g_params.worldHeight = header.height;
+  g_seed = header.seed;
 
-      // Vertical contributions
-      if (starty < bug->y) {
-        if (g_worldCell->type[screen_pos] == FOOD) {
-          up += FOOD_HEALTH;
-        } else if (g_worldCell->type[screen_pos] == POISON) {
-          up -= POISON_COST;
-        } else if (g_worldCell->type[screen_pos] == BUG) {
-          up += bug->aggr + bug->drive;
-        }
-      } else if (starty > bug->y) {
-        if (g_worldCell->type[screen_pos] == FOOD) {
-          down += FOOD_HEALTH;
-        } else if (g_worldCell->type[screen_pos] == POISON) {
-          down -= POISON_COST;
-        } else if (g_worldCell->type[screen_pos] == BUG) {
-          down += bug->aggr + bug->drive;
+  RecordTrailer trailer;
+  if (g_replay.size >= sizeof(header) + sizeof(trailer)) {
+    memcpy(&trailer, g_replay.map + g_replay.size - sizeof(trailer),
+           sizeof(trailer));
+    if (memcmp(trailer.magic, RECORD_INDEX_MAGIC, sizeof(trailer.magic)) ==
+            0 &&
+        trailer.keyframes > 0 &&
+        trailer.indexAt + trailer.keyframes * 2 * sizeof(u_int64_t) +
+                sizeof(trailer) ==
+            g_replay.size) {
+      g_replay.index = malloc(trailer.keyframes * 2 * sizeof(u_int64_t));
+      if (g_replay.index == NULL) {
+        perror("Error: Unable to allocate memory for the recording index");
+        exit(1);
+      }
+      memcpy(g_replay.index, g_replay.map + trailer.indexAt,
+             trailer.keyframes * 2 * sizeof(u_int64_t));
+      g_replay.keyframes = trailer.keyframes;
+      g_replay.end = trailer.end;
+      g_replay.size = trailer.indexAt; // where the records stop
+      return;
+    }
+  }
+  size_t capacity = 0;
+  for (size_t at = sizeof(header); at < g_replay.size;) {
+    int kind;
+    u_int64_t frame;
+    Cursor body;
+    size_t next = readRecord(at, &kind, &frame, &body);
+    if (next == 0) {
+      g_replay.size = at; // the run stopped part way through writing it
+      break;
+    }
+    if (kind == RECORD_FRAME) {
+      g_replay.end = frame + 1;
+    } else if (kind == RECORD_KEYFRAME) {
+      if (g_replay.keyframes == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        g_replay.index =
+            realloc(g_replay.index, capacity * 2 * sizeof(u_int64_t));
+        if (g_replay.index == NULL) {
+          perror("Error: Unable to allocate memory for the recording index");
+          exit(1);
         }
       }
-
-      // Optionally, handle cells exactly at bug->x and bug->y as needed.
+      g_replay.index[2 * g_replay.keyframes] = frame;
+      g_replay.index[2 * g_replay.keyframes + 1] = at;
+      ++g_replay.keyframes;
+    } else {
+      badRecording();
     }
+    at = next;
   }
+  if (g_replay.keyframes == 0)
+    badRecording();
+  printf("%s has no index, so it was read through\n", name);
+}
 
-  // Use softmax for horizontal and vertical probabilities.
-  double alpha = 0.01;
-  double weightL = exp(alpha * left);
-  double weightR = exp(alpha * right);
-  double pLeft = weightL / (weightL + weightR);
-
-  double weightU = exp(alpha * up);
-  double weightD = exp(alpha * down);
-  double pUp = weightU / (weightU + weightD);
+void closeReplay(void) {
+  if (g_replay.map == NULL)
+    return;
+  munmap((void *)g_replay.map, g_replay.mapSize);
+  free(g_replay.index);
+  g_replay.map = NULL;
+}
 
-  // Store probabilities (scaled as percentages)
-  *left_prob = (int)(pLeft * 100);
-  *up_prob = (int)(pUp * 100);
+double getSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-void bugDeath(Bug *bugs, int idx, u_int64_t screen_pos) {
-  if (bugs[idx].isAlive == 0) {
-    return;
+// set the knob called name (see PARAM_NAMES). Returns 0 if there is no
+// such knob or value isn't a number, or a whole one for a whole knob
+int setParam(const char *name, const char *value) {
+  char *end;
+  double v = strtod(value, &end);
+  if (end == value || *end != '\0')
+    return 0;
+  for (int k = 0; k < NBR_PARAMS; ++k) {
+    if (strcmp(PARAM_NAMES[k].name, name) != 0)
+      continue;
+    char *field = (char *)&g_params + PARAM_NAMES[k].offset;
+    if (PARAM_NAMES[k].isInt &&
+        (v != floor(v) || v < INT_MIN || v > INT_MAX))
+      return 0;
+    if (PARAM_NAMES[k].isInt)
+      *(int *)field = (int)v;
+    else
+      *(double *)field = v;
+    g_paramsGiven |= 1ull << k;
+    return 1;
   }
-  g_worldCell->color[screen_pos] = BLACK;
-  bugs[idx].isAlive = 0;
-  bugs[idx].age = 0;
-  g_worldCell->bug_idx[screen_pos] = -1;
-  g_worldCell->type[screen_pos] = EMPTY;
-  ++g_deaths;
+  return 0;
 }
 
-int bugsAreSameSex(Bug *bug1, Bug *bug2) {
-  return bug1->sex == bug2->sex ? 1 : 0;
+void writeParams(FILE *fp) {
+  fprintf(fp, "# seed %lu\n", g_seed);
+  for (int k = 0; k < NBR_PARAMS; ++k) {
+    char *field = (char *)&g_params + PARAM_NAMES[k].offset;
+    if (PARAM_NAMES[k].isInt)
+      fprintf(fp, "# %s %d\n", PARAM_NAMES[k].name, *(int *)field);
+    else
+      fprintf(fp, "# %s %g\n", PARAM_NAMES[k].name, *(double *)field);
+  }
 }
 
-int getDeadBugIndex(Bug *bugs) {
-  // printf("looking for dead bug among %lu bugs\n", g_numBugs);
-  for (int i = 0; i < g_numBugs; ++i) {
-    if (!bugs[i].isAlive) {
-      // printf("Found dead bug at index %d\n", i);
-      return i;
-    }
+// the limits the rest of the code relies on: a bug sees at most 15 cells
+// away and the world wraps only once, and the dense world's cells are
+// counted in ints
+int checkParams(void) {
+#ifdef FIXED_WORLD_WIDTH
+  if (g_params.worldWidth != FIXED_WORLD_WIDTH ||
+      g_params.worldHeight != FIXED_WORLD_HEIGHT) {
+    printf("Error: this build's world is fixed at %dx%d\n", FIXED_WORLD_WIDTH,
+           FIXED_WORLD_HEIGHT);
+    return 0;
   }
-  // printf("Error: No dead bugs found\n");
-  return -1;
+#endif
+#ifdef CHUNKED_WORLD
+  if (WORLD_WIDTH < 32 || WORLD_HEIGHT < 32 || WORLD_WIDTH > 1 << 24 ||
+      WORLD_HEIGHT > 1 << 24) {
+    printf("Error: the world must be at least 32x32 and at most 2^24 cells "
+           "a side\n");
+    return 0;
+  }
+#else
+  if (WORLD_WIDTH < 32 || WORLD_HEIGHT < 32 ||
+      (int64_t)WORLD_WIDTH * WORLD_HEIGHT > 1 << 30) {
+    printf("Error: the world must be at least 32x32 and at most 2^30 "
+           "cells\n");
+    return 0;
+  }
+#endif
+  if (FRAMES_TILL_FOOD < 1) {
+    printf("Error: frames_till_food must be at least 1\n");
+    return 0;
+  }
+  if (INIT_VISION < -1 || INIT_VISION > 15) {
+    printf("Error: init_vision must be -1 (random) or 0 to 15\n");
+    return 0;
+  }
+  return 1;
 }
 
-/// @brief Create a new bug using the DNA of the parents
-Bug *birthABug(Bug *bugs, int dad_idx, int mom_idx, u_int64_t mom_pos,
-               u_int64_t dad_pos) {
-  int baby_idx = getDeadBugIndex(bugs);
+#ifndef HEADLESS
+// The window build simulates on a thread of its own and hands finished
+// frames to the window (the main thread, which owns the GL context) through
+// two buffers. The simulation only paints a frame once the window has taken
+// the last one, and only hands it over if the window isn't busy with the
+// lock, so it never waits for the display. Rows that changed since the
+// window last uploaded are flagged, so only those go to the texture.
+typedef struct FrameExchange {
+  pthread_mutex_t lock;
+  Color *front;         // the latest frame, guarded by lock
+  Color *back;          // the simulation's to paint into
+  unsigned char *dirty; // rows of front the texture doesn't have yet
+  int fresh;            // front holds a frame the window hasn't taken
+  u_int64_t frame;      // status line of front
+  int64_t alive;
+  int quit, done;
+} FrameExchange;
+FrameExchange g_frames;
 
-  if (baby_idx == -1 && g_numBugs >= WORLD_WIDTH * WORLD_HEIGHT) {
-    printf("Error: Too many bugs\n");
-    return bugs;
+// At normal speed the simulation steps once per frame the window shows.
+// Fast-forward runs it flat out and paints only FAST_FORWARD_FPS frames a
+// second, so the number of steps per shown frame follows how long a step
+// takes. The window sets fast, until_frame and until_event; the simulation
+// clears them and pauses when it gets there
+typedef struct SimRun {
+  u_int64_t frame, first_frame, max_frames;
+  const char *checkpoint_name;
+  u_int64_t checkpoint_every;
+  FILE *ofp;
+  u_int64_t shown; // frame when the last one was painted
+  int fast;
+  u_int64_t until_frame; // 0 = none
+  int until_event;       // until the population halves or doubles
+} SimRun;
+
+// returns 0 if the window hasn't taken the last frame yet or is busy
+static int publishFrame(u_int64_t frame) {
+  if (__atomic_load_n(&g_frames.fresh, __ATOMIC_ACQUIRE))
+    return 0;
+  renderWorld(g_frames.back);
+  if (pthread_mutex_trylock(&g_frames.lock) != 0)
+    return 0;
+  for (int y = 0; y < WORLD_HEIGHT; ++y)
+    if (memcmp(&g_frames.back[y * WORLD_WIDTH], &g_frames.front[y * WORLD_WIDTH],
+               WORLD_WIDTH * sizeof(Color)) != 0)
+      g_frames.dirty[y] = 1;
+  Color *painted = g_frames.back;
+  g_frames.back = g_frames.front;
+  g_frames.front = painted;
+  g_frames.frame = frame;
+  g_frames.alive = g_stats.alive;
+  __atomic_store_n(&g_frames.fresh, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&g_frames.lock);
+  return 1;
+}
+
+// whether a run-until target was reached, clearing it if so
+static int reachedTarget(SimRun *run, int64_t *event_base) {
+  u_int64_t until_frame = __atomic_load_n(&run->until_frame, __ATOMIC_RELAXED);
+  if (until_frame && run->frame >= until_frame) {
+    __atomic_store_n(&run->until_frame, 0, __ATOMIC_RELAXED);
+    return 1;
   }
-  if (baby_idx == -1) {
-    bugs = realloc(bugs, (g_numBugs + 1) * sizeof(Bug));
-    if (bugs == NULL) {
-      perror("Error: Unable to allocate memory for bugs\n");
-      exit(1);
+  if (!__atomic_load_n(&run->until_event, __ATOMIC_RELAXED)) {
+    *event_base = -1;
+    return 0;
+  }
+  if (*event_base < 0) {
+    *event_base = g_bugs.live;
+    return 0;
+  }
+  if (g_bugs.live * POP_EVENT_RATIO > *event_base &&
+      g_bugs.live < *event_base * POP_EVENT_RATIO)
+    return 0;
+  __atomic_store_n(&run->until_event, 0, __ATOMIC_RELAXED);
+  *event_base = -1;
+  return 1;
+}
+
+static void *simThread(void *arg) {
+  SimRun *run = arg;
+  int64_t event_base = -1;
+  double painted_at = 0;
+  while (!__atomic_load_n(&g_frames.quit, __ATOMIC_ACQUIRE) &&
+         (run->max_frames == 0 ||
+          run->frame - run->first_frame < run->max_frames)) {
+    if (__atomic_load_n(&PAUSE, __ATOMIC_RELAXED)) {
+      // show the frame it stopped on, which fast-forward may not have
+      if (run->shown != run->frame && publishFrame(run->frame - 1))
+        run->shown = run->frame;
+      usleep(1000);
+      continue;
+    }
+    int fast = __atomic_load_n(&run->fast, __ATOMIC_RELAXED);
+    if (!fast && __atomic_load_n(&g_frames.fresh, __ATOMIC_ACQUIRE)) {
+      usleep(500);
+      continue;
+    }
+    if (g_replay.map == NULL) {
+      simulateFrame(run->frame);
+    } else if (!replayFrame(run->frame)) {
+      __atomic_store_n(&PAUSE, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&run->fast, 0, __ATOMIC_RELAXED);
+      printf("End of the recording at frame %lu\n", run->frame);
+      continue;
+    }
+    PROFILE_START(PROF_STATS);
+    updateStatusLine(run->frame, run->ofp);
+    PROFILE_STOP(PROF_STATS);
+    takeSnapshots(run->frame);
+    ++run->frame;
+    if (run->checkpoint_name && run->checkpoint_every &&
+        run->frame % run->checkpoint_every == 0) {
+      PROFILE_START(PROF_CHECKPOINT);
+      saveCheckpoint(run->checkpoint_name, run->frame);
+      PROFILE_STOP(PROF_CHECKPOINT);
     }
-    baby_idx = g_numBugs;
-    ++g_numBugs;
+    if (reachedTarget(run, &event_base)) {
+      __atomic_store_n(&run->fast, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&PAUSE, 1, __ATOMIC_RELAXED);
+      printf("Stopped at frame %lu with %d bugs\n", run->frame - 1,
+             g_bugs.live);
+      fast = 0;
+    }
+    PROFILE_START(PROF_PAINT);
+    double now = fast ? getSeconds() : 0;
+    if (!fast || now - painted_at >= 1.0 / FAST_FORWARD_FPS) {
+      if (publishFrame(run->frame - 1)) {
+        run->shown = run->frame;
+        painted_at = now;
+      }
+    }
+    PROFILE_STOP(PROF_PAINT);
+    PROFILE_FRAME(run->frame - 1);
   }
+  __atomic_store_n(&g_frames.done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
 
-  Bug *baby = &bugs[baby_idx];
-  Bug *mom = &bugs[mom_idx];
-  Bug *dad = &bugs[dad_idx];
-  // DNA is a combination of the parents' DNA
-  baby->health = (mom->health + dad->health) / 2;
-  baby->vision = (mom->vision + dad->vision) / 2;
-  baby->speed = (mom->speed + dad->speed) / 2;
-  baby->drive = (mom->drive + dad->drive) / 2;
-  baby->aggr = (mom->aggr + dad->aggr) / 2;
-  baby->sex = gsl_rng_get(g_rng) % 2;
-  baby->isAlive = 1;
-  baby->age = 0;
-  // perform  a mutation
-  if (gsl_rng_get(g_rng) % 100 >= MUTATION_RATE * 100) {
-    int bit = gsl_rng_get(g_rng) % 32;
-    baby->dna ^= 1 << bit;
+// take the latest frame, if there is one, uploading the rows that changed,
+// and its status line
+static void takeFrame(Texture2D texture, u_int64_t *frame, int64_t *alive) {
+  pthread_mutex_lock(&g_frames.lock);
+  *frame = g_frames.frame;
+  *alive = g_frames.alive;
+  if (g_frames.fresh) {
+    for (int y = 0; y < WORLD_HEIGHT;) {
+      if (!g_frames.dirty[y]) {
+        ++y;
+        continue;
+      }
+      int rows = 1;
+      while (y + rows < WORLD_HEIGHT && g_frames.dirty[y + rows])
+        ++rows;
+      UpdateTextureRec(texture, (Rectangle){0, y, WORLD_WIDTH, rows},
+                       &g_frames.front[y * WORLD_WIDTH]);
+      memset(&g_frames.dirty[y], 0, rows);
+      y += rows;
+    }
+    __atomic_store_n(&g_frames.fresh, 0, __ATOMIC_RELEASE);
   }
+  pthread_mutex_unlock(&g_frames.lock);
+}
+#endif
+
+// A sweep runs every combination of the values in a grid file, one run per
+// process and up to jobs at a time. Each line of the file is a knob name
+// (or seed) followed by its values, e.g.
+//   mutation_rate 0.1 0.3 0.5
+//   seed 1 2 3
+// Run n writes its status log, headed by its settings, to GRID.nnnn.log,
+// the run number padded to four digits.
+#define SWEEP_MAX_AXES 32
+#define SWEEP_MAX_VALUES 256
+
+typedef struct SweepAxis {
+  char *name;
+  char *values[SWEEP_MAX_VALUES];
+  int count;
+} SweepAxis;
+
+static void freeSweepAxes(SweepAxis *axes, int naxes) {
+  for (int a = 0; a < naxes; ++a) {
+    free(axes[a].name);
+    for (int v = 0; v < axes[a].count; ++v)
+      free(axes[a].values[v]);
+  }
+}
 
-  // find a place to put the baby
-  for (int i = mom_pos - 1; i > 0; --i) {
-    if (g_worldCell->type[i] == EMPTY) {
-      baby->x = i % WORLD_WIDTH;
-      baby->y = i / WORLD_WIDTH;
+// Returns 1 in each run's process, with its knobs set and run_log holding
+// the name of its log. Returns 0 in the calling process once every run has
+// finished, or -1 if the grid is bad or a run failed.
+int runSweep(const char *grid_name, int jobs, char *run_log, size_t size) {
+  FILE *fp = fopen(grid_name, "r");
+  if (fp == NULL) {
+    perror("Error: Unable to open sweep grid");
+    return -1;
+  }
+  SweepAxis axes[SWEEP_MAX_AXES];
+  int naxes = 0, runs = 1, ok = 1;
+  char line[4096];
+  while (ok && fgets(line, sizeof(line), fp)) {
+    char *name = strtok(line, " \t\r\n=,");
+    if (name == NULL || name[0] == '#')
+      continue;
+    if (naxes == SWEEP_MAX_AXES) {
+      printf("Error: more than %d knobs in the sweep\n", SWEEP_MAX_AXES);
+      ok = 0;
       break;
     }
-  }
-  if (baby->x == 0 && baby->y == 0) {
-    for (int i = mom_pos + 1; i < WORLD_WIDTH * WORLD_HEIGHT; ++i) {
-      if (g_worldCell->type[i] == EMPTY) {
-        baby->x = i % WORLD_WIDTH;
-        baby->y = i / WORLD_WIDTH;
+    SweepAxis *axis = &axes[naxes++];
+    axis->name = strdup(name);
+    axis->count = 0;
+    char *value;
+    while ((value = strtok(NULL, " \t\r\n=,")) != NULL) {
+      if (axis->count == SWEEP_MAX_VALUES) {
+        printf("Error: more than %d values for %s in the sweep\n",
+               SWEEP_MAX_VALUES, axis->name);
+        ok = 0;
         break;
       }
+      axis->values[axis->count++] = strdup(value);
+    }
+    // try the values on a copy of the knobs to catch typos before any run
+    Params saved = g_params;
+    u_int64_t given = g_paramsGiven;
+    for (int v = 0; ok && v < axis->count; ++v) {
+      if (strcmp(axis->name, "seed") != 0 &&
+          !setParam(axis->name, axis->values[v])) {
+        printf("Error: bad sweep setting %s %s\n", axis->name,
+               axis->values[v]);
+        ok = 0;
+      }
+    }
+    g_params = saved;
+    g_paramsGiven = given;
+    if (ok && axis->count == 0) {
+      printf("Error: no values for %s in the sweep\n", axis->name);
+      ok = 0;
     }
+    runs *= axis->count;
   }
-  if (baby->x == 0 && baby->y == 0) {
-    printf("Error: No space to put baby\n");
-    bugs[baby_idx].isAlive = 0;
+  fclose(fp);
+  if (!ok) {
+    freeSweepAxes(axes, naxes);
+    return -1;
   }
 
-  calculateDNA(baby);
+  int running = 0, failed = 0;
+  for (int run = 0; run < runs; ++run) {
+    if (running == jobs) {
+      int status;
+      wait(&status);
+      failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+      --running;
+    }
+    printf("Run %d:", run);
+    for (int a = 0, rest = run; a < naxes; rest /= axes[a++].count)
+      printf(" %s=%s", axes[a].name, axes[a].values[rest % axes[a].count]);
+    printf("\n");
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("Error: Unable to start a sweep run");
+      freeSweepAxes(axes, naxes);
+      return -1;
+    }
+    if (pid == 0) {
+      for (int a = 0, rest = run; a < naxes; rest /= axes[a++].count) {
+        const char *value = axes[a].values[rest % axes[a].count];
+        if (strcmp(axes[a].name, "seed") == 0)
+          g_seed = strtoull(value, NULL, 0);
+        else
+          setParam(axes[a].name, value);
+      }
+      snprintf(run_log, size, "%s.%04d.log", grid_name, run);
+      freeSweepAxes(axes, naxes);
+      // the run's own chatter would drown the sweep's
+      if (freopen("/dev/null", "w", stdout) == NULL)
+        exit(1);
+      return 1;
+    }
+    ++running;
+  }
+  while (running-- > 0) {
+    int status;
+    wait(&status);
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  freeSweepAxes(axes, naxes);
+  if (failed) {
+    printf("Error: some sweep runs failed\n");
+    return -1;
+  }
+  printf("Sweep of %d runs done\n", runs);
+  return 0;
+}
 
-  if (mom->health <= MATING_COST) {
-    mom->health = 0;
-  } else
-    mom->health -= MATING_COST;
-  if (dad->health <= MATING_COST) {
-    dad->health = 0;
-  } else
-    dad->health -= MATING_COST;
-  ++g_births;
+// The benchmark runs canonical scenarios, each a fixed seed and a set of
+// knobs, one at a time in a process of its own so no run inherits another's
+// memory, and prints a CSV line per scenario for comparing builds. The
+// frame counts keep each scenario to a few seconds.
+#define BENCH_SEED 1
 
-  return bugs;
-}
+typedef struct BenchScenario {
+  const char *name;
+  u_int64_t frames;
+  const char *settings; // NAME=VALUE ...
+} BenchScenario;
 
-//-------------------------------------------------------------
-// bugFight - fight to the death
-// ** updated - bug1 always wins - it can see bug2's health before the fight
-// ----------------------------------------------------------
-void bugFight(Bug *bugs, int idx1, int idx2, u_int64_t screen_pos) {
+const BenchScenario BENCH_SCENARIOS[] = {
+    {"sparse", 1000, "init_bug_prob=0.002"},
+    {"dense", 30, "init_bug_prob=0.9"},
+    {"vision15", 200, "init_vision=15"},
+    {"food", 200, "regenerate_food_rate=0.01 frames_till_food=1"},
+    {"mating", 80, "mating_cost=10 fighting_cost=10 food_health=25 "
+                   "min_mating_age=0 min_fighting_age=0"},
+};
+#define NBR_BENCH_SCENARIOS \
+  (int)(sizeof(BENCH_SCENARIOS) / sizeof(BENCH_SCENARIOS[0]))
 
-  int new_health = (bugs[idx1].health + bugs[idx2].health) - FIGHTING_COST;
-  /*
-  printf("bug2[%d](%d,%d) h:%d age:%d\tbug1[%d](%d,%d) h:%d age:%d\n", idx2,
-         bugs[idx2].x, bugs[idx2].y, bugs[idx2].health, bugs[idx2].age, idx1,
-         bugs[idx1].x, bugs[idx1].y, bugs[idx1].health, bugs[idx1].age);
-         */
+// what a scenario's process hands back through its pipe
+typedef struct BenchResult {
+  u_int64_t frames, bugSteps;
+  double seconds;
+  long peakKb;
+  int64_t alive;
+} BenchResult;
 
-  bugs[idx2].health = 0;
-  if (new_health > 255)
-    new_health = 255;
-  else if (new_health <= 0)
-    new_health = 0;
-  bugs[idx1].health = new_health;
-  ++g_fights;
+static int applySettings(const char *settings) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", settings);
+  for (char *set = strtok(buf, " "); set; set = strtok(NULL, " ")) {
+    char *value = strchr(set, '=');
+    if (value == NULL)
+      return 0;
+    *value++ = '\0';
+    if (!setParam(set, value))
+      return 0;
+  }
+  return 1;
 }
 
-Bug *initializeWorld(Bug *bugs) {
-  printf("Initializing world\n");
-  // create a block of poison
-  for (int x = 250; x < 300; ++x) {
-    for (int y = 250; y < 300; ++y) {
-      int i = y * WORLD_WIDTH + x;
-      g_worldCell->type[i] = POISON;
-      g_worldCell->color[i] = RED;
+// Like runSweep: returns 1 in each scenario's process, with its knobs, seed
+// and *frames set (unless *frames was already non-zero) and *result_fd the
+// pipe to write its BenchResult to. Returns 0 in the calling process once
+// every scenario listed in names (comma separated, or "all") has run, or -1
+// if a name is unknown or a run failed.
+int runBench(const char *names, int threads, u_int64_t *frames,
+             int *result_fd) {
+  int chosen[NBR_BENCH_SCENARIOS], nchosen = 0;
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", names);
+  for (char *name = strtok(buf, ","); name; name = strtok(NULL, ",")) {
+    int found = 0;
+    for (int k = 0; k < NBR_BENCH_SCENARIOS; ++k) {
+      if (strcmp(name, "all") != 0 &&
+          strcmp(name, BENCH_SCENARIOS[k].name) != 0)
+        continue;
+      found = 1;
+      if (nchosen < NBR_BENCH_SCENARIOS)
+        chosen[nchosen++] = k;
+    }
+    if (!found) {
+      printf("Error: no benchmark scenario called %s\n", name);
+      return -1;
     }
   }
-  for (int i = 0; i < NBR_FOOD_SQUARES; ++i) {
-    addFood();
-  }
-  for (int i = 0; i < WORLD_WIDTH * WORLD_HEIGHT; ++i) {
-    if (g_worldCell->type[i] == POISON) {
-      continue;
+
+  printf("scenario,seed,frames,threads,bug_steps,seconds,ns_per_bug_step,"
+         "frames_per_s,peak_rss_kb,alive\n");
+  int failed = 0;
+  for (int c = 0; c < nchosen; ++c) {
+    const BenchScenario *scenario = &BENCH_SCENARIOS[chosen[c]];
+    int fds[2];
+    fflush(stdout);
+    if (pipe(fds) != 0) {
+      perror("Error: Unable to start a benchmark run");
+      return -1;
     }
-    if (g_worldCell->type[i] == FOOD) {
-      continue;
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("Error: Unable to start a benchmark run");
+      return -1;
     }
-    if (gsl_rng_get(g_rng) % 10000 < INIT_BUG_PROB * 10000) {
-      bugs = immaculateBirthABug(i, bugs);
-    } else if (gsl_rng_get(g_rng) % 100 < INIT_FOOD_PROB * 100) {
-      g_worldCell->type[i] = FOOD;
-      g_worldCell->color[i] = FOOD_COLOR;
-      g_worldCell->color[i].a = FOOD_OPACITY;
-    } else if (gsl_rng_get(g_rng) % 10000 < INIT_POISON_PROB * 10000) {
-      g_worldCell->type[i] = POISON;
-      g_worldCell->color[i] = RED;
-    } else {
-      g_worldCell->type[i] = EMPTY;
-      g_worldCell->color[i] = BLACK;
+    if (pid == 0) {
+      close(fds[0]);
+      *result_fd = fds[1];
+      g_seed = BENCH_SEED;
+      if (*frames == 0)
+        *frames = scenario->frames;
+      if (!applySettings(scenario->settings))
+        exit(1);
+      if (freopen("/dev/null", "w", stdout) == NULL)
+        exit(1);
+      return 1;
+    }
+    close(fds[1]);
+    BenchResult result;
+    ssize_t got = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(result) || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      printf("Error: benchmark %s failed\n", scenario->name);
+      failed = 1;
+      continue;
     }
+    printf("%s,%d,%lu,%d,%lu,%.3f,%.1f,%.1f,%ld,%ld\n", scenario->name,
+           BENCH_SEED, result.frames, threads, result.bugSteps,
+           result.seconds,
+           result.bugSteps ? result.seconds * 1e9 / result.bugSteps : 0.0,
+           result.seconds > 0 ? result.frames / result.seconds : 0.0,
+           result.peakKb, result.alive);
   }
+  return failed ? -1 : 0;
+}
 
-  return bugs;
+void usage(const char *prog) {
+  printf("usage: %s [--frames N] [--log FILE] [--no-log] "
+         "[--compact-every N] [--threads N] [--seed N]\n"
+         "       [--stats-every N] [--stats-detail] [--checkpoint FILE]\n"
+         "       [--checkpoint-every N] [--restore FILE] [--set NAME=VALUE]\n"
+         "       [--telemetry FILE] [--telemetry-csv FILE] [--sweep GRID]\n"
+         "       [--jobs N] [--bench LIST] [--procs N] [--record FILE]\n"
+         "       [--replay FILE] [--replay-from N] "
+         "[--compact-order slot|morton]\n"
+         "       [--verbose] [--capture FILE] [--capture-every N]\n"
+         "       [--census FILE] [--census-every N] [--lineage FILE]\n",
+         prog);
+  printf("  --frames N   stop after simulating N frames (headless default %d, "
+         "0 = run until the window is closed)\n",
+         HEADLESS_DEFAULT_FRAMES);
+  printf("  --log FILE   write the per-frame status log to FILE "
+         "(default bug_simulation.log)\n");
+  printf("  --no-log     don't write the status log\n");
+  printf("  --telemetry FILE\n"
+         "               write the population statistics to FILE in binary "
+         "columns\n"
+         "               from a thread of its own, instead of the status "
+         "log\n");
+  printf("  --telemetry-csv FILE\n"
+         "               print a telemetry file as CSV and exit\n");
+  printf("  --capture FILE\n"
+         "               write a video of the run to FILE: PPM frames for "
+         ".ppm, Y4M\n"
+         "               for .y4m, raw RGB otherwise, or Y4M to the command "
+         "after a |\n");
+  printf("  --capture-every N\n"
+         "               capture every Nth frame (default 1)\n");
+  printf("  --census FILE\n"
+         "               write the number of bugs of every genotype to FILE "
+         "as CSV\n");
+  printf("  --census-every N\n"
+         "               frames between census snapshots (default 100)\n");
+  printf("  --lineage FILE\n"
+         "               write every bug's parents and genotype to FILE\n");
+  printf("  --record FILE\n"
+         "               record every move, birth, death, fight and food "
+         "placement\n"
+         "               to FILE, with the whole world every %d frames\n",
+         RECORD_KEYFRAME_EVERY);
+  printf("  --replay FILE\n"
+         "               play a recording back instead of simulating; "
+         "--frames\n"
+         "               frames of it (default: all of it)\n");
+  printf("  --replay-from N\n"
+         "               start the replay at frame N, from the keyframe "
+         "before it\n");
+  printf("  --compact-every N\n"
+         "               pack live bugs into the lowest slots every N "
+         "frames\n");
+  printf("  --compact-order slot|morton\n"
+         "               keep the bugs' order when packing them (default), "
+         "or sort\n"
+         "               them along a Morton curve of their places\n");
+  printf("  --threads N  step the world in parallel tiles on N threads; the "
+         "result\n"
+         "               depends on the seed only, not on N\n");
+#ifdef HEADLESS
+  printf("  --procs N    like --threads, but on N processes sharing the "
+         "world, each\n"
+         "               stepping a strip of it\n");
+#endif
+  printf("  --seed N     seed of the random numbers (default: the time); "
+         "the same\n"
+         "               seed replays a run bit for bit\n");
+  printf("  --stats-every N\n"
+         "               write a status log line every N frames (default 1)\n");
+  printf("  --verbose    print every bug of the first frame and its DNA\n");
+  printf("  --stats-detail\n"
+         "               add the spread and a histogram of every trait to "
+         "the log\n");
+  printf("  --checkpoint FILE\n"
+         "               save the whole simulation to FILE when the run "
+         "ends\n");
+  printf("  --checkpoint-every N\n"
+         "               also save it every N frames\n");
+  printf("  --restore FILE\n"
+         "               carry on from a checkpoint, with its knobs, instead "
+         "of a new\n"
+         "               world; with --seed, the run forks off with a "
+         "different seed\n");
+  printf("  --set NAME=VALUE\n"
+         "               change a tuning knob, e.g. --set mutation_rate=0.1; "
+         "the\n"
+         "               knobs and their defaults:\n");
+  for (int k = 0; k < NBR_PARAMS; ++k) {
+    char *field = (char *)&g_params + PARAM_NAMES[k].offset;
+    if (PARAM_NAMES[k].isInt)
+      printf("                 %-24s %d\n", PARAM_NAMES[k].name,
+             *(int *)field);
+    else
+      printf("                 %-24s %g\n", PARAM_NAMES[k].name,
+             *(double *)field);
+  }
+#ifdef PROFILE
+  printf("  --profile FILE\n"
+         "               write per frame phase times and counters to FILE\n");
+  printf("  --profile-format csv|trace\n"
+         "               CSV (default) or a Chrome trace for chrome://tracing\n");
+#endif
+#ifdef HEADLESS
+  printf("  --sweep GRID run every combination of the knob values listed in "
+         "GRID,\n"
+         "               one line per knob: NAME VALUE...; run n logs to "
+         "GRID.nnnn.log\n");
+  printf("  --jobs N     how many sweep runs at a time (default: one per "
+         "core)\n");
+  printf("  --bench LIST run the benchmark scenarios in LIST (comma "
+         "separated, or all)\n"
+         "               and print a CSV line each; --frames overrides "
+         "their length:\n");
+  for (int k = 0; k < NBR_BENCH_SCENARIOS; ++k)
+    printf("                 %-10s %4lu frames  %s\n",
+           BENCH_SCENARIOS[k].name, BENCH_SCENARIOS[k].frames,
+           BENCH_SCENARIOS[k].settings);
+#else
+  printf("  --run-until N\n"
+         "               fast-forward to frame N, then pause\n");
+  printf("keys: space pauses, F toggles fast-forward, E fast-forwards until "
+         "the\n"
+         "      population halves or grows %dx\n",
+         POP_EVENT_RATIO);
+#endif
 }
 
 int main(int argc, char **argv) {
   FILE *ofp = NULL;
-  if (argc == 1) {
-    ofp = fopen("bug_simulation.log", "w");
+  const char *log_name = "bug_simulation.log";
+  int log_given = 0;
+  const char *telemetry_name = NULL;
+  const char *capture_name = NULL;
+  u_int64_t capture_every = 1;
+  const char *census_name = NULL, *lineage_name = NULL;
+  u_int64_t census_every = 100;
+  const char *record_name = NULL, *replay_name = NULL;
+  u_int64_t replay_from = 0;
+#ifdef HEADLESS
+  u_int64_t max_frames = HEADLESS_DEFAULT_FRAMES;
+  int frames_given = 0;
+  const char *bench_names = NULL;
+  int bench_fd = -1;
+  u_int64_t bug_steps = 0;
+#else
+  u_int64_t max_frames = 0;
+  u_int64_t until_frame = 0;
+#endif
+  int threads = 0, procs = 0;
+  const char *checkpoint_name = NULL, *restore_name = NULL;
+  u_int64_t checkpoint_every = 0;
+  int seed_given = 0;
+  const char *sweep_name = NULL;
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#ifdef PROFILE
+  const char *profile_name = NULL;
+  int profile_trace = 0;
+#endif
+  g_seed = time(NULL);
+  for (int a = 1; a < argc; ++a) {
+    if (strcmp(argv[a], "--frames") == 0 && a + 1 < argc) {
+      max_frames = strtoull(argv[++a], NULL, 10);
+#ifdef HEADLESS
+      frames_given = 1;
+#endif
+    } else if (strcmp(argv[a], "--log") == 0 && a + 1 < argc) {
+      log_name = argv[++a];
+      log_given = 1;
+    } else if (strcmp(argv[a], "--no-log") == 0) {
+      log_name = NULL;
+      log_given = 1;
+    } else if (strcmp(argv[a], "--telemetry") == 0 && a + 1 < argc) {
+      telemetry_name = argv[++a];
+    } else if (strcmp(argv[a], "--telemetry-csv") == 0 && a + 1 < argc) {
+      return !telemetryToCsv(argv[a + 1], stdout);
+    } else if (strcmp(argv[a], "--capture") == 0 && a + 1 < argc) {
+      capture_name = argv[++a];
+    } else if (strcmp(argv[a], "--capture-every") == 0 && a + 1 < argc) {
+      capture_every = strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--census") == 0 && a + 1 < argc) {
+      census_name = argv[++a];
+    } else if (strcmp(argv[a], "--census-every") == 0 && a + 1 < argc) {
+      census_every = strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--lineage") == 0 && a + 1 < argc) {
+      lineage_name = argv[++a];
+    } else if (strcmp(argv[a], "--record") == 0 && a + 1 < argc) {
+      record_name = argv[++a];
+    } else if (strcmp(argv[a], "--replay") == 0 && a + 1 < argc) {
+      replay_name = argv[++a];
+    } else if (strcmp(argv[a], "--replay-from") == 0 && a + 1 < argc) {
+      replay_from = strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--compact-every") == 0 && a + 1 < argc) {
+      g_compactEvery = strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--compact-order") == 0 && a + 1 < argc) {
+      ++a;
+      if (strcmp(argv[a], "morton") == 0) {
+        g_compactMorton = 1;
+      } else if (strcmp(argv[a], "slot") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+      threads = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "--seed") == 0 && a + 1 < argc) {
+      g_seed = strtoull(argv[++a], NULL, 0);
+      seed_given = 1;
+    } else if (strcmp(argv[a], "--stats-every") == 0 && a + 1 < argc) {
+      g_statsEvery = strtoull(argv[++a], NULL, 10);
+      if (g_statsEvery == 0)
+        g_statsEvery = 1;
+    } else if (strcmp(argv[a], "--verbose") == 0) {
+      g_verbose = 1;
+    } else if (strcmp(argv[a], "--stats-detail") == 0) {
+      g_statsDetail = 1;
+    } else if (strcmp(argv[a], "--checkpoint") == 0 && a + 1 < argc) {
+      checkpoint_name = argv[++a];
+    } else if (strcmp(argv[a], "--checkpoint-every") == 0 && a + 1 < argc) {
+      checkpoint_every = strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--restore") == 0 && a + 1 < argc) {
+      restore_name = argv[++a];
+    } else if (strcmp(argv[a], "--set") == 0 && a + 1 < argc) {
+      char *value = strchr(argv[++a], '=');
+      if (value == NULL) {
+        usage(argv[0]);
+        return 1;
+      }
+      *value++ = '\0';
+      if (!setParam(argv[a], value)) {
+        printf("Error: bad setting %s=%s\n", argv[a], value);
+        return 1;
+      }
+#ifdef PROFILE
+    } else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc) {
+      profile_name = argv[++a];
+    } else if (strcmp(argv[a], "--profile-format") == 0 && a + 1 < argc) {
+      ++a;
+      if (strcmp(argv[a], "trace") == 0) {
+        profile_trace = 1;
+      } else if (strcmp(argv[a], "csv") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+#endif
+#ifdef HEADLESS
+    } else if (strcmp(argv[a], "--sweep") == 0 && a + 1 < argc) {
+      sweep_name = argv[++a];
+    } else if (strcmp(argv[a], "--jobs") == 0 && a + 1 < argc) {
+      jobs = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "--bench") == 0 && a + 1 < argc) {
+      bench_names = argv[++a];
+    } else if (strcmp(argv[a], "--procs") == 0 && a + 1 < argc) {
+      threads = atoi(argv[++a]);
+      procs = threads > 0;
+#else
+    } else if (strcmp(argv[a], "--run-until") == 0 && a + 1 < argc) {
+      until_frame = strtoull(argv[++a], NULL, 10);
+#endif
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
   }
-  g_rng = gsl_rng_alloc(gsl_rng_mt19937);
-  gsl_rng_set(g_rng, time(NULL));
-
-  g_worldCell = (struct WorldCell *)malloc(sizeof(struct WorldCell));
-
-  if (g_worldCell == NULL) {
-    printf("Error: Unable to allocate memory for g_worldCell\n");
+  char run_log[4096];
+  if (sweep_name && (telemetry_name || record_name || capture_name ||
+                     census_name || lineage_name)) {
+    printf("Error: a sweep writes a status log per run, not telemetry, a "
+           "recording, a capture, a census or a lineage\n");
     return 1;
   }
-  for (int i = 0; i < WORLD_WIDTH * WORLD_HEIGHT; ++i) {
-    g_worldCell->type[i] = EMPTY;
-    g_worldCell->color[i] = BLACK;
-    g_worldCell->bug_idx[i] = -1;
+  if (lineage_name && restore_name) {
+    printf("Error: a lineage starts with the first bugs, not from a "
+           "checkpoint\n");
+    return 1;
+  }
+  if (replay_name) {
+    if (restore_name || record_name || telemetry_name || sweep_name ||
+        checkpoint_name || procs || census_name || lineage_name) {
+      printf("Error: --replay plays a recording back; it can't be combined "
+             "with options that simulate\n");
+      return 1;
+    }
+    openReplay(replay_name);
+    threads = 0;
+    log_name = NULL; // a replay has no statistics
+#ifdef HEADLESS
+    bench_names = NULL;
+#endif
+  }
+  if (sweep_name) {
+    printf("Seed: %lu\n", g_seed);
+    int sweep = runSweep(sweep_name, jobs > 0 ? jobs : 1, run_log,
+                         sizeof(run_log));
+    if (sweep <= 0)
+      return sweep < 0;
+    log_name = run_log;
+  }
+#ifdef HEADLESS
+  if (bench_names) {
+    if (!frames_given)
+      max_frames = 0;
+    int bench = runBench(bench_names, threads, &max_frames, &bench_fd);
+    if (bench <= 0)
+      return bench < 0;
+    log_name = NULL;
+  }
+#endif
+  if (restore_name)
+    openCheckpoint(restore_name);
+  if (!checkParams())
+    return 1;
+#ifdef CHUNKED_WORLD
+  if (procs) {
+    printf("Error: --procs needs the whole world in shared memory\n");
+    return 1;
   }
+#endif
+  if (record_name)
+    openRecord(record_name);
+  if (capture_name)
+    openCapture(capture_name, capture_every);
+  if (census_name)
+    openCensus(census_name, census_every);
+  if (lineage_name)
+    openLineage(lineage_name);
+  if (telemetry_name) {
+    openTelemetry(telemetry_name);
+    // the telemetry replaces the text log unless that was asked for too
+    if (!log_given)
+      log_name = NULL;
+  }
+  if (log_name) {
+    ofp = fopen(log_name, "w");
+    if (ofp == NULL) {
+      perror("Error: Unable to open log file");
+      return 1;
+    }
+    if (sweep_name)
+      writeParams(ofp);
+  }
+#ifdef PROFILE
+  calibrateProfile();
+  if (profile_name)
+    openProfile(profile_name, profile_trace);
+#endif
+  if (restore_name == NULL && replay_name == NULL)
+    printf("Seed: %lu\n", g_seed);
+
+  if (procs) {
+    // room for the world and its free blocks, a full pool grown by
+    // doubling, the tile order and the draws, and then some
+    size_t cells = (size_t)WORLD_WIDTH * WORLD_HEIGHT;
+    openArena(cells * 160 + ((size_t)256 << 20));
+  }
+  allocWorld();
+  g_census = sharedCalloc(CENSUS_GENOTYPES, sizeof(int32_t));
+  if (g_census == NULL) {
+    perror("Error: Unable to allocate memory for the census");
+    exit(1);
+  }
+#ifndef HEADLESS
   // Initialize raylib
   InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Bug Simulation");
   MaximizeWindow();
-  SetTargetFPS(120);
+  SetTargetFPS(TARGET_FPS);
+#endif
 
   // Initialize random number generator
   // srand(time(NULL));
   // srand(1234);
 
   // Create bugs
-  Bug *bugs = NULL;
-
-  bugs = initializeWorld(bugs);
-
   u_int64_t frame = 0;
-  updateStatusLine(&bugs[0], frame, ofp);
+  if (replay_name) {
+    buildFreeBlocks();
+    frame = replaySeek(replay_from ? replay_from : g_replay.index[0]);
+    printf("Replaying %s from frame %lu (it ends at %lu)\n", replay_name,
+           frame, g_replay.end);
+  } else if (restore_name) {
+    frame = restoreCheckpoint(seed_given);
+    printf("Restored frame %lu from %s\nSeed: %lu\n", frame, restore_name,
+           g_seed);
+  } else {
+    initializeWorld(threads);
+  }
+  // before the tiles, so --procs helpers start out with them
+  buildFreeBlocks();
+  buildSoftmaxTable();
+  if (threads > 0) {
+    // the summed-area table is shared by every bug, so the tiled step
+    // scans neighbourhoods directly instead
+    if (!initTiles(threads, procs)) {
+      printf("Error: World too small to split into tiles\n");
+      return 1;
+    }
+  } else if (replay_name == NULL) {
+#ifndef CHUNKED_WORLD
+    // the table is as big as the whole world, so the chunked world does
+    // without it and scans
+    buildTypeTree();
+#endif
+  }
+
+  u_int64_t first_frame = frame;
+  // a restored run picks up the log where the checkpointed run left it
+  if (restore_name == NULL)
+    updateStatusLine(frame, ofp);
 
-  Image img = {.data = g_worldCell->color,
+#ifdef HEADLESS
+  // run flat out: no window, no frame pacing, no texture uploads
+  if (replay_name && !frames_given)
+    max_frames = g_replay.end - frame;
+  double start = getSeconds();
+  while (frame - first_frame < max_frames) {
+    bug_steps += g_bugs.live;
+    if (replay_name) {
+      if (!replayFrame(frame))
+        break;
+    } else {
+      simulateFrame(frame);
+    }
+    PROFILE_START(PROF_STATS);
+    updateStatusLine(frame, ofp);
+    PROFILE_STOP(PROF_STATS);
+    takeSnapshots(frame);
+    ++frame;
+    if (checkpoint_name && checkpoint_every &&
+        frame % checkpoint_every == 0) {
+      PROFILE_START(PROF_CHECKPOINT);
+      saveCheckpoint(checkpoint_name, frame);
+      PROFILE_STOP(PROF_CHECKPOINT);
+    }
+    PROFILE_FRAME(frame - 1);
+  }
+  double elapsed = getSeconds() - start;
+  printf("%s %lu frames in %.3f s (%.1f frames/s)\n",
+         replay_name ? "Replayed" : "Simulated", frame - first_frame, elapsed,
+         elapsed > 0 ? (frame - first_frame) / elapsed : 0.0);
+  if (replay_name) {
+    u_int64_t cells[4] = {0};
+    for (int y = 0; y < WORLD_HEIGHT; ++y)
+      for (int x = 0; x < WORLD_WIDTH; ++x)
+        ++cells[cellType(cellPos(x, y))];
+    printf("Before frame %lu: %lu bug, %lu food and %lu poison cells\n",
+           frame, cells[BUG], cells[FOOD], cells[POISON]);
+  }
+  if (bench_fd >= 0) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    BenchResult result = {.frames = frame - first_frame,
+                          .bugSteps = bug_steps,
+                          .seconds = elapsed,
+                          .peakKb = usage.ru_maxrss,
+                          .alive = g_bugs.live};
+    if (write(bench_fd, &result, sizeof(result)) != sizeof(result))
+      return 1;
+    close(bench_fd);
+  }
+#else
+  g_frames.front = malloc(sizeof(Color) * WORLD_WIDTH * WORLD_HEIGHT);
+  g_frames.back = malloc(sizeof(Color) * WORLD_WIDTH * WORLD_HEIGHT);
+  g_frames.dirty = calloc(WORLD_HEIGHT, 1);
+  if (g_frames.front == NULL || g_frames.back == NULL ||
+      g_frames.dirty == NULL) {
+    printf("Error: Unable to allocate memory for the frame\n");
+    return 1;
+  }
+  pthread_mutex_init(&g_frames.lock, NULL);
+  renderWorld(g_frames.front);
+  Image img = {.data = g_frames.front,
                .width = WORLD_WIDTH,
                .height = WORLD_HEIGHT,
                .mipmaps = 1,
                .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
   Texture2D texture = LoadTextureFromImage(img);
 
-  // set STDIN to non-blocking
-  // Main game loop
-  while (!WindowShouldClose()) {
+  SimRun run = {.frame = frame,
+                .first_frame = first_frame,
+                .max_frames = max_frames,
+                .checkpoint_name = checkpoint_name,
+                .checkpoint_every = checkpoint_every,
+                .ofp = ofp,
+                .shown = frame,
+                .fast = until_frame > frame,
+                .until_frame = until_frame > frame ? until_frame : 0};
+  pthread_t sim;
+  pthread_create(&sim, NULL, simThread, &run);
+  u_int64_t shown_frame = frame;
+  int64_t shown_alive = g_stats.alive;
+  // simulated frames a second, measured over the last half second or so
+  double rate = 0, rate_at = getSeconds();
+  u_int64_t rate_frame = frame;
+
+  // Main game loop: draw at the display's pace while the simulation runs
+  // as fast as it can
+  while (!WindowShouldClose() &&
+         !__atomic_load_n(&g_frames.done, __ATOMIC_ACQUIRE)) {
     if (IsKeyPressed(KEY_SPACE)) {
-      PAUSE = !PAUSE;
+      __atomic_store_n(&PAUSE, !PAUSE, __ATOMIC_RELAXED);
       printf("PAUSE: %d\n", PAUSE);
     }
-    if (!PAUSE) {
-      for (int i = 0; i < g_numBugs; ++i) {
-        if (!bugs[i].isAlive)
-          continue;
-
-        u_int64_t screen_pos = bugs[i].y * WORLD_WIDTH + bugs[i].x;
-        u_int64_t old_screen_pos = screen_pos;
-        g_worldCell->color[screen_pos] = BLACK;
-        g_worldCell->bug_idx[screen_pos] = -1;
-        g_worldCell->type[screen_pos] = EMPTY;
-        screen_pos = bugMove(&bugs[i]);
-        // moving could mean the death of the bug
-        if (bugs[i].health == 0) {
-          bugDeath(bugs, i, screen_pos);
-          continue;
-        }
-        // the bug is in a new position (but not yet stored in the world)
-        // see what they landed on and act accordingly
-        if (g_worldCell->type[screen_pos] == FOOD) {
-          bugs[i].health += bugs[i].health > 255 - FOOD_HEALTH
-                                ? 255 - bugs[i].health
-                                : FOOD_HEALTH;
-        } else if (g_worldCell->type[screen_pos] == POISON) {
-          bugs[i].health -=
-              bugs[i].health < POISON_COST ? bugs[i].health : POISON_COST;
-          if (bugs[i].health == 0) {
-            bugDeath(bugs, i, screen_pos);
-            continue;
-          }
-        } else if (g_worldCell->type[screen_pos] == BUG) {
-          if (!bugsAreSameSex(&bugs[g_worldCell->bug_idx[screen_pos]],
-                              &bugs[i])) {
-            // if bugs are not the same sex and their drive is high enough, and
-            // if they are old enough, and if they have enough health---mate
-            if (bugs[i].drive > gsl_rng_get(g_rng) % 16 &&
-                bugs[i].health > MATING_COST &&
-                bugs[g_worldCell->bug_idx[screen_pos]].health > MATING_COST &&
-                bugs[i].age >= MIN_MATING_AGE &&
-                bugs[g_worldCell->bug_idx[screen_pos]].age >= MIN_MATING_AGE) {
-              bugs = birthABug(bugs, i, g_worldCell->bug_idx[screen_pos],
-                               screen_pos, old_screen_pos);
-            }
-          } else if (bugs[i].aggr > gsl_rng_get(g_rng) % 16 &&
-                     bugs[i].age >= MIN_FIGHTING_AGE &&
-                     bugs[i].health >
-                         bugs[g_worldCell->bug_idx[screen_pos]].health) {
-            bugFight(bugs, i, g_worldCell->bug_idx[screen_pos], screen_pos);
-            if (bugs[g_worldCell->bug_idx[screen_pos]].health == 0) {
-              bugDeath(bugs, g_worldCell->bug_idx[screen_pos], screen_pos);
-            }
-            if (bugs[i].health == 0) {
-              bugDeath(bugs, i, screen_pos);
-              continue;
-            }
-          }
-        }
-        calculateDNA(&bugs[i]);
-        if (bugs[i].isAlive) {
-          // set screen pixel to bug color
-          g_worldCell->color[screen_pos].r = bugs[i].dna >> 24 & 0xff;
-          g_worldCell->color[screen_pos].g = bugs[i].dna >> 16 & 0xff;
-          g_worldCell->color[screen_pos].b = bugs[i].dna >> 8 & 0xff;
-          g_worldCell->color[screen_pos].a = bugs[i].dna & 0xff;
-          g_worldCell->type[screen_pos] = BUG;
-          g_worldCell->bug_idx[screen_pos] = i;
-          bugs[i].age++;
-        }
-      }
-      if (frame % 100 == 0) {
-        printf("Frame: %lu Fights:%d Births:%d Deaths:%d  PopX:%d\n", frame,
-               g_fights, g_births, g_deaths, g_births - g_deaths);
-        g_births = 0;
-        g_fights = 0;
-        g_deaths = 0;
-      }
-      // regenerate food and poison -- old way
-      for (int i = 0; i < WORLD_WIDTH * WORLD_HEIGHT; ++i) {
-        if (g_worldCell->type[i] == EMPTY) {
-          if (gsl_rng_get(g_rng) % 10000 < REGENERATE_FOOD_RATE * 10000) {
-            g_worldCell->type[i] = FOOD;
-            g_worldCell->color[i] = FOOD_COLOR;
-            g_worldCell->color[i].a = FOOD_OPACITY;
-          } else if (gsl_rng_get(g_rng) % 100000 <
-                     REGENERATE_POISON_RATE * 100000) {
-            g_worldCell->type[i] = POISON;
-            g_worldCell->color[i] = RED;
-          }
-        }
-      }
-      // food regeneration - new way
-      if (frame % FRAMES_TILL_FOOD == 0) {
-        addFood();
+    if (IsKeyPressed(KEY_F)) {
+      int fast = !__atomic_load_n(&run.fast, __ATOMIC_RELAXED);
+      if (!fast) {
+        __atomic_store_n(&run.until_frame, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&run.until_event, 0, __ATOMIC_RELAXED);
       }
-      updateStatusLine(bugs, frame, ofp);
-      ++frame;
+      __atomic_store_n(&run.fast, fast, __ATOMIC_RELAXED);
+      printf("FAST FORWARD: %d\n", fast);
+    }
+    if (IsKeyPressed(KEY_E) && shown_alive > 0) {
+      __atomic_store_n(&run.until_event, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&run.fast, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&PAUSE, 0, __ATOMIC_RELAXED);
+      printf("Fast forward until the population halves or grows %dx\n",
+             POP_EVENT_RATIO);
+    }
+    PROFILE_START(PROF_UPLOAD);
+    takeFrame(texture, &shown_frame, &shown_alive);
+    PROFILE_STOP(PROF_UPLOAD);
+    double now = getSeconds();
+    if (now - rate_at >= 0.5) {
+      rate = (shown_frame - rate_frame) / (now - rate_at);
+      rate_at = now;
+      rate_frame = shown_frame;
     }
     // Draw frame
+    PROFILE_START(PROF_DRAW);
     BeginDrawing();
     ClearBackground(BLACK);
-    UpdateTexture(texture, g_worldCell->color);
     DrawTexture(texture, 0, 0, WHITE);
+    char status_line[100];
+    sprintf(status_line, "BUGS: %ld\tFrame: %8lu\t%8.1f frames/s%s",
+            shown_alive, shown_frame, rate,
+            __atomic_load_n(&run.fast, __ATOMIC_RELAXED) ? "\tFAST FORWARD"
+                                                         : "");
+    DrawText(status_line, 10, SCREEN_HEIGHT - 23, 20, WHITE);
     EndDrawing();
+    PROFILE_STOP(PROF_DRAW);
   }
+  __atomic_store_n(&g_frames.quit, 1, __ATOMIC_RELEASE);
+  pthread_join(sim, NULL);
+  frame = run.frame;
 
   // Deinitialize raylib
+  UnloadTexture(texture);
   CloseWindow();
-  free(g_worldCell);
-  free(bugs);
+  pthread_mutex_destroy(&g_frames.lock);
+  free(g_frames.front);
+  free(g_frames.back);
+  free(g_frames.dirty);
+#endif
+  if (checkpoint_name)
+    saveCheckpoint(checkpoint_name, frame);
+  closeRecord();
+  closeReplay();
+  closeLineage();
+  freeTiles();
+  freeWorld();
+  sharedFree(g_serialStep.events.data);
+  free(g_typeTree);
+  sharedFree(g_bugs.x);
+  sharedFree(g_bugs.y);
+  sharedFree(g_bugs.age);
+  sharedFree(g_bugs.health);
+  sharedFree(g_bugs.sex);
+  sharedFree(g_bugs.vision);
+  sharedFree(g_bugs.speed);
+  sharedFree(g_bugs.drive);
+  sharedFree(g_bugs.aggr);
+  sharedFree(g_bugs.dna);
+  for (int k = 0; k < BUG_POOL_LEVELS; ++k)
+    sharedFree(g_bugs.free[k]);
+  sharedFree(g_moveDraws);
+  sharedFree(g_census);
+  if (g_arena)
+    munmap(g_arena, g_arenaSize);
   if (ofp)
     fclose(ofp);
+  closeTelemetry();
+  closeCapture();
+  closeCensus();
+#ifdef PROFILE
+  closeProfile();
+#endif
 
   return 0;
 }
 
-void addFood(void) {
+void addFood(RngBlock draw) {
   // x and y start in random places
-  int startx = gsl_rng_get(g_rng) % WORLD_WIDTH;
-  int starty = gsl_rng_get(g_rng) % WORLD_HEIGHT;
+  int startx = draw.v[0] % WORLD_WIDTH;
+  int starty = draw.v[1] % WORLD_HEIGHT;
+  if (g_record.file) {
+    putByte(&g_record.frame, EV_FOOD);
+    putVarint(&g_record.frame, startx);
+    putVarint(&g_record.frame, starty);
+    putVarint(&g_record.frame, FOOD_SIZE_X);
+    putVarint(&g_record.frame, FOOD_SIZE_Y);
+  }
+  putFood(startx, starty, FOOD_SIZE_X, FOOD_SIZE_Y);
+}
 
-  for (int x = startx; x < startx + FOOD_SIZE_X; ++x) {
-    for (int y = starty; y < starty + FOOD_SIZE_Y; ++y) {
-      int i = y * WORLD_WIDTH + x;
-      if (i < WORLD_WIDTH * WORLD_HEIGHT && g_worldCell->type[i] != BUG) {
-        g_worldCell->type[i] = FOOD;
-        g_worldCell->color[i] = FOOD_COLOR;
-        g_worldCell->color[i].a = FOOD_OPACITY;
+// a width by height square of food from (startx, starty), around bugs
+void putFood(int startx, int starty, int width, int height) {
+  for (int x = startx; x < startx + width; ++x) {
+    for (int y = starty; y < starty + height; ++y) {
+      // past the right edge the square carries on at the start of the
+      // next row
+      int cx = x, cy = y;
+      while (cx >= WORLD_WIDTH) {
+        cx -= WORLD_WIDTH;
+        ++cy;
+      }
+      if (cy < WORLD_HEIGHT && cellType(cellPos(cx, cy)) != BUG) {
+        setCellType(cellPos(cx, cy), FOOD);
       }
     }
   }